@@ -1,5 +1,8 @@
 #include <auditutils/auditutils.hpp>
 #include <sstream>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
 #include <auditutils/_x_oldauditutils.hpp>
 
 /*
@@ -23,10 +26,11 @@ void run(size_t loopCount) {
   size_t addrlen = 0;
   std::vector<std::string> saddrs = { saddrv4b, saddrv6a, saddr_zero, saddr_netlink, saddr2, saddr_socket};
   SockAddrInfo info;
+  char path[AuditParseUtils::UNIX_PATH_MAX];
   for (size_t i = 0; i < loopCount; i++) {
     for (auto saddr : saddrs) {
       info = SockAddrInfo();
-      bool success = AuditParseUtils::parseSockAddr(saddr.c_str(), saddr.size(), info);
+      bool success = AuditParseUtils::parseSockAddr(saddr.c_str(), saddr.size(), info, path, sizeof(path));
       if (success) {
 
         if (info.family == AuditParseUtils::FAM_IPV4) {
@@ -44,6 +48,61 @@ void run(size_t loopCount) {
   }
 }
 
+/*
+ * Address and port text formatting: snprintf path vs. table-driven formatters.
+ */
+static std::string ip4Snprintf(uint32_t addr) {
+  char tmp[32];
+  snprintf(tmp,sizeof(tmp), "%d.%d.%d.%d", (addr >> 24)& 0x00FF, (addr >> 16)& 0x00FF, (addr >> 8) & 0x00FF, addr & 0x00FF);
+  return std::string(tmp);
+}
+
+static std::string ip6Snprintf(const uint8_t *a) {
+  char tmp[48];
+  snprintf(tmp, sizeof(tmp), "%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x",
+           a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11], a[12], a[13], a[14], a[15]);
+  return std::string(tmp);
+}
+
+void runFormat(size_t loopCount) {
+  std::vector<std::string> saddrs = { saddrv4b, saddrv6a, saddr2 };
+  std::vector<SockAddrInfo> infos;
+  for (auto saddr : saddrs) {
+    SockAddrInfo info = SockAddrInfo();
+    AuditParseUtils::parseSockAddr(saddr.c_str(), saddr.size(), info);
+    infos.push_back(info);
+  }
+
+  for (int useFormatters = 0; useFormatters < 2; useFormatters++) {
+    size_t textlen = 0;
+    char addrbuf[AuditParseUtils::IP6_TEXT_MAX];
+    char portbuf[AuditParseUtils::PORT_TEXT_MAX];
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < loopCount; i++) {
+      for (auto &info : infos) {
+        if (useFormatters) {
+          if (info.family == AuditParseUtils::FAM_IPV4) {
+            textlen += AuditParseUtils::formatIp4(addrbuf, info.addr4);
+          } else {
+            textlen += AuditParseUtils::formatIp6(addrbuf, info.addr6);
+          }
+          textlen += AuditParseUtils::formatPort(portbuf, info.port);
+        } else {
+          if (info.family == AuditParseUtils::FAM_IPV4) {
+            textlen += ip4Snprintf(info.addr4).size();
+          } else {
+            textlen += ip6Snprintf(info.addr6).size();
+          }
+          textlen += std::to_string(info.port).size();
+        }
+      }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double nsPer = elapsed.count() * 1e9 / (double)(loopCount * infos.size());
+    printf("%-10s : %6.1f ns/addr+port (%zu)\n", (useFormatters ? "formatters" : "snprintf"), nsPer, textlen & 1);
+  }
+}
+
 void runOld(size_t loopCount) {
 
   std::vector<std::string> saddrs = { saddrv4b, saddrv6a, saddr_zero, saddr_netlink, saddr2, saddr_socket};
@@ -56,9 +115,57 @@ void runOld(size_t loopCount) {
   }
 }
 
+/*
+ * Reports hex2ascii() and checkedHex2ascii() decode throughput
+ * (GB/s of hex input) for each implementation supported on this CPU.
+ */
+void runHexDecode() {
+  const size_t sizes[] = { 32, 4096 };
+  const size_t totalBytes = 1ULL << 30;
+
+  for (size_t srclen : sizes) {
+    std::string src(srclen, '0');
+    for (size_t i = 0; i < srclen; i++) {
+      src[i] = "0123456789ABCDEFabcdef"[(i * 7 + 3) % 22];
+    }
+    std::vector<char> dest(srclen / 2);
+    size_t loopCount = totalBytes / srclen;
+
+    for (int impl = Hexi::IMPL_SCALAR; impl < Hexi::IMPL_COUNT; impl++) {
+      if (!Hexi::isSupported((Hexi::DecodeImpl)impl)) {
+        continue;
+      }
+      for (int checked = 0; checked < 2; checked++) {
+        size_t sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < loopCount; i++) {
+          if (checked) {
+            sum += Hexi::checkedHex2ascii((Hexi::DecodeImpl)impl, dest.data(), dest.size(), src.data(), src.size());
+          } else {
+            Hexi::hex2ascii((Hexi::DecodeImpl)impl, dest.data(), dest.size(), src.data(), src.size());
+          }
+          sum += (uint8_t)dest[i % dest.size()];
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double gbps = (double)(loopCount * srclen) / elapsed.count() / 1e9;
+        printf("%-16s %-6s %5zu B : %6.2f GB/s (%zu)\n", (checked ? "checkedHex2ascii" : "hex2ascii"),
+               Hexi::implName((Hexi::DecodeImpl)impl), srclen, gbps, sum & 1);
+      }
+    }
+  }
+}
 
 int main(int argc, char *argv[])
 {
+  if (argc == 2 && strcmp(argv[1], "hex") == 0) {
+    runHexDecode();
+    return 0;
+  }
+  if (argc == 2 && strcmp(argv[1], "fmt") == 0) {
+    runFormat(2000000);
+    return 0;
+  }
+
   bool useOld = false;
   if (argc == 2) {
     useOld = true;
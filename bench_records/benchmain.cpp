@@ -1,5 +1,10 @@
 #include <auditutils/auditutils.hpp>
 #include <sstream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+#include <string.h>
 #include <auditutils/auditrec_parser.hpp>
 #include <unistd.h>
 
@@ -20,24 +25,17 @@ struct MyAuditListener : public AuditListener {
   }
 };
 
-static inline void FILL_REPLY(SPAuditRecBuf spRecBuf, const ExampleRec &rec) {
-  auto spReply = std::static_pointer_cast<AuditReplyBuf>(spRecBuf);
-  strcpy(spReply->data(false), rec.msg.data());
-  spReply->len = rec.msg.size();
-  spReply->type = rec.rectype;
-}
-
 void run(size_t loopCount) {
   auto listener = std::make_shared<MyAuditListener>();
   auto spCollector = AuditCollectorNew(listener);
-  
+  audit_reply reply;
+
   for (size_t i = 0; i < loopCount; i++) {
 
     for (int i=0; i < ex1_records.size(); i++) {
-      auto spReply = spCollector->allocReply();
-      FILL_REPLY(spReply, ex1_records[i]);
-      
-      spCollector->onAuditRecord(spReply);
+      FILL_REPLY(reply, ex1_records[i]);
+
+      spCollector->onAuditRecord(reply);
       usleep(2);
     }
     spCollector->flush();
@@ -46,11 +44,185 @@ void run(size_t loopCount) {
   }
 }
 
+/*
+ * Reads the fields a typical consumer needs from each group.
+ */
+struct FieldReadingListener : public AuditListener {
+  virtual ~FieldReadingListener() {}
+  bool onAuditRecords(SPAuditGroup spRecordGroup) override {
+    std::string value;
+    spRecordGroup->getField(FID_SYSCALL, value, "", 1300);
+    total += value.size();
+    spRecordGroup->getField(FID_PID, value, "", 1300);
+    total += value.size();
+    spRecordGroup->getField(FID_AUID, value, "", 1300);
+    total += value.size();
+    spRecordGroup->getPathField(FID_EXE, value, "", 1300);
+    total += value.size();
+    spRecordGroup->getField(FID_SADDR, value, "", 1306);
+    total += value.size();
+    spRecordGroup->getPathField(FID_CWD, value, "", 1307);
+    total += value.size();
+    spRecordGroup->getPathField(FID_NAME, value, "", 1302);
+    total += value.size();
+    spRecordGroup->release();
+    return false;
+  }
+  size_t total {0};
+};
 
+/*
+ * Field parsing cost per record with the generic tokenizer, the
+ * fixed-schema parser and the learned shape cache.
+ */
+void runParse(size_t loopCount) {
+  const char *names[] = { "generic", "fixed-schema", "shape-cache" };
+  for (int mode = 0; mode < 3; mode++) {
+    auto listener = std::make_shared<FieldReadingListener>();
+    auto spShapes = ShapeCacheFieldsParserNew();
+    SPAuditRecParsers spParsers;
+    if (mode == 1) {
+      spParsers = AuditRecParsersNew({FixedSchemaFieldsParserNew()});
+    } else if (mode == 2) {
+      spParsers = AuditRecParsersNew({spShapes});
+    }
+    auto spCollector = AuditCollectorNew(listener, 500, spParsers);
+    audit_reply reply;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < loopCount; i++) {
+      for (size_t j = 0; j < ex1_records.size(); j++) {
+        FILL_REPLY(reply, ex1_records[j]);
+        spCollector->onAuditRecord(reply);
+      }
+      spCollector->flush();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    printf("%-13s %7.1f ns/record", names[mode], ns / (loopCount * ex1_records.size()));
+    if (mode == 2) {
+      printf("  hits:%llu misses:%llu", (unsigned long long)spShapes->getHits(),
+             (unsigned long long)spShapes->getMisses());
+    }
+    printf("  (%zu)\n", listener->total);
+  }
+}
+
+/*
+ * Ingest cost per record, receiving into an audit_reply that the
+ * collector copies into the group arena.
+ */
+void runIngest(const char *label, const std::vector<ExampleRec> &records, size_t loopCount) {
+  auto listener = std::make_shared<MyAuditListener>();
+  auto spCollector = AuditCollectorNew(listener);
+  audit_reply reply;
+  size_t dropped = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < loopCount; i++) {
+    for (size_t j = 0; j < records.size(); j++) {
+      FILL_REPLY(reply, records[j]);
+      dropped += spCollector->onAuditRecord(reply);
+    }
+    spCollector->flush();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  printf("%-6s %7.1f ns/record  dropped:%zu\n", label,
+         ns / (loopCount * records.size()), dropped);
+}
+
+/*
+ * Groups of a SYSCALL record and an EXECVE record with long arguments,
+ * of about recordSize bytes.
+ */
+std::vector<ExampleRec> makeLongRecords(size_t recordSize) {
+  std::vector<ExampleRec> records;
+  for (int i = 0; i < 8; i++) {
+    std::string preamble = "audit(1566400374.798:" + std::to_string(300 + i) + "): ";
+    std::string args = "argc=2 a0=\"/usr/bin/cat\" a1=\"";
+    args.append(recordSize - preamble.size() - args.size() - 1, 'x');
+    records.push_back(ExampleRec{1300, ex1_records[0].msg.substr(0, 21) + std::to_string(300 + i) +
+                                 ex1_records[0].msg.substr(24)});
+    records.push_back(ExampleRec{1309, preamble + args + "\""});
+    records.push_back(ExampleRec{1320, preamble});
+  }
+  return records;
+}
+
+/*
+ * Cost of alloc+recycle when buffers are allocated on one thread and
+ * recycled on another, as between a reader and a worker.
+ */
+void runAllocContention(int numPairs, int numAllocs) {
+  auto spa = std::make_shared<AuditRecAllocator>(500);
+  AuditMPMCQueue<SPAuditRecBuf> handoff(256);
+  std::atomic<int> numFailed(0);
+  std::atomic<int> numDone(0);
+
+  audit_reply reply;
+  FILL_REPLY(reply, ex1_records[0]);
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < numPairs; i++) {
+    threads.push_back(std::thread([&]() {
+      for (int n = 0; n < numAllocs; n++) {
+        SPAuditRecBuf spBuf = spa->alloc(reply.msg, reply.type, reply.len);
+        if (spBuf == nullptr) {
+          numFailed++;
+          std::this_thread::yield();
+          continue;
+        }
+        while (!handoff.push(spBuf)) {
+          std::this_thread::yield();
+        }
+      }
+      numDone++;
+    }));
+    threads.push_back(std::thread([&]() {
+      SPAuditRecBuf spBuf;
+      for (;;) {
+        if (handoff.pop(spBuf)) {
+          spa->recycle(spBuf);
+          spBuf.reset();
+        } else if (numDone == numPairs) {
+          break;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }));
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  printf("%d threads: %.1f ns per alloc+recycle, %d retries\n", numPairs * 2,
+         ns / (numPairs * numAllocs), numFailed.load());
+}
 
 int main(int argc, char *argv[])
 {
   size_t loopCount = 50000;
+  if (argc == 2 && strcmp(argv[1], "parse") == 0) {
+    runParse(loopCount);
+    return 0;
+  }
+  if (argc == 2 && strcmp(argv[1], "ingest") == 0) {
+    runIngest("short", ex1_records, loopCount);
+    runIngest("long", makeLongRecords(4000), loopCount / 10);
+    return 0;
+  }
+  if (argc == 2 && strcmp(argv[1], "alloc") == 0) {
+    runAllocContention(1, 200000);
+    runAllocContention(2, 200000);
+    return 0;
+  }
   run(loopCount);
 
 }
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <bitset>
+#include <initializer_list>
+#include <map>
+
+/*
+ * Integer IDs for the well-known audit record field names.
+ * Names outside this vocabulary map to FID_UNKNOWN and are looked up
+ * by string.
+ */
+enum AuditFieldId : uint16_t {
+  FID_UNKNOWN = 0,
+  FID_ARCH,
+  FID_SYSCALL,
+  FID_SUCCESS,
+  FID_EXIT,
+  FID_A0,
+  FID_A1,
+  FID_A2,
+  FID_A3,
+  FID_ITEMS,
+  FID_PPID,
+  FID_PID,
+  FID_AUID,
+  FID_UID,
+  FID_GID,
+  FID_EUID,
+  FID_SUID,
+  FID_FSUID,
+  FID_EGID,
+  FID_SGID,
+  FID_FSGID,
+  FID_TTY,
+  FID_SES,
+  FID_COMM,
+  FID_EXE,
+  FID_KEY,
+  FID_SUBJ,
+  FID_NAME,
+  FID_INODE,
+  FID_DEV,
+  FID_MODE,
+  FID_OUID,
+  FID_OGID,
+  FID_RDEV,
+  FID_NAMETYPE,
+  FID_CAP_FP,
+  FID_CAP_FI,
+  FID_CAP_FE,
+  FID_CAP_FVER,
+  FID_CAP_FROOTID,
+  FID_OBJ,
+  FID_CWD,
+  FID_PROCTITLE,
+  FID_SADDR,
+  FID_ARGC,
+  FID_RES,
+  FID_OP,
+  FID_ACCT,
+  FID_HOSTNAME,
+  FID_ADDR,
+  FID_TERMINAL,
+  FID_MSG,
+  FID_ITEM,
+  FID_FAMILY,
+  FID_LADDR,
+  FID_LPORT,
+  FID_FADDR,
+  FID_FPORT,
+  FID_OLD_AUID,
+  FID_OLD_SES,
+  FID_SIG,
+  FID_NARGS,
+  FID_FD0,
+  FID_FD1,
+  FID_CAP_PI,
+  FID_CAP_PE,
+  FID_CAP_PP,
+  FID_CAP_PA,
+  FID_OLD_PP,
+  FID_OLD_PI,
+  FID_OLD_PE,
+  FID_NEW_PP,
+  FID_NEW_PI,
+  FID_NEW_PE,
+  FID_PATH,
+  FID_SCONTEXT,
+  FID_TCONTEXT,
+  FID_TCLASS,
+  FID_COUNT
+};
+
+static_assert(FID_COUNT <= 128, "AuditRecFieldIndex keeps a 128 bit set of field IDs");
+
+/*
+ * How a field value appears in the record text, as classified by the
+ * tokenizer.
+ */
+enum AuditValueEncoding : uint8_t {
+  VALUE_PLAIN = 0,   // unquoted, e.g. numbers and flags
+  VALUE_QUOTED,      // "..." or '...'
+  VALUE_HEX,         // unquoted, even length, hex digits only
+  VALUE_LITERAL      // (null), (none) or ?
+};
+
+/*
+ * Perfect hash of the field vocabulary.  The slot is taken from the
+ * FNV-1a key hash that AuditRecFieldIndex already computes, so
+ * resolving an ID costs one table read and one memcmp.
+ * The slot table is built from name() on first use.  HASH_MULT must
+ * put every known name in a distinct slot; if a new name collides,
+ * the build asserts, and in release builds the later name is
+ * resolved as FID_UNKNOWN.  The field_ids test checks every name.
+ * To pick a new multiplier, try odd values until slotsCollide()
+ * returns false.
+ */
+struct AuditFieldIds {
+  enum : uint32_t { HASH_MULT = 0x34d2aa8fU };
+
+  /*
+   * FNV-1a
+   */
+  static uint32_t hash(const char *key, size_t keylen) {
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < keylen; i++) {
+      h = (h ^ (uint8_t)key[i]) * 16777619U;
+    }
+    return h;
+  }
+
+  static AuditFieldId lookup(const char *key, size_t keylen, uint32_t h) {
+    uint8_t id = _slots()[(uint32_t)(h * HASH_MULT) >> 24];
+    const char *known = name((AuditFieldId)id);
+    if (id != FID_UNKNOWN && strlen(known) == keylen && memcmp(known, key, keylen) == 0) {
+      return (AuditFieldId)id;
+    }
+    return FID_UNKNOWN;
+  }
+
+  static AuditFieldId lookup(const char *key, size_t keylen) {
+    return lookup(key, keylen, hash(key, keylen));
+  }
+
+  /*
+   * True for fields whose values auditd writes hex-encoded when they
+   * contain spaces, quotes or control chars, and quoted otherwise.
+   * Execve arguments also qualify, see isExecveArg().
+   */
+  static bool isEncoded(AuditFieldId id) {
+    switch (id) {
+      case FID_COMM:
+      case FID_EXE:
+      case FID_KEY:
+      case FID_NAME:
+      case FID_CWD:
+      case FID_PROCTITLE:
+      case FID_ACCT:
+      case FID_HOSTNAME:
+      case FID_PATH:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  /*
+   * True for a0, a1, ... which are encoded in EXECVE (1309) records,
+   * but plain hex numbers in SYSCALL records.
+   */
+  static bool isExecveArg(const char *key, size_t keylen) {
+    if (keylen < 2 || key[0] != 'a') {
+      return false;
+    }
+    for (size_t i = 1; i < keylen; i++) {
+      if (key[i] < '0' || key[i] > '9') {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /*
+   * @return field name, or "" for FID_UNKNOWN and out of range values.
+   */
+  static const char *name(AuditFieldId id) {
+    static const char * const names[FID_COUNT] = {
+      "",
+      "arch", "syscall", "success", "exit", "a0", "a1", "a2", "a3", "items", "ppid",
+      "pid", "auid", "uid", "gid", "euid", "suid", "fsuid", "egid", "sgid", "fsgid",
+      "tty", "ses", "comm", "exe", "key", "subj", "name", "inode", "dev", "mode",
+      "ouid", "ogid", "rdev", "nametype", "cap_fp", "cap_fi", "cap_fe", "cap_fver",
+      "cap_frootid", "obj", "cwd", "proctitle", "saddr", "argc", "res", "op", "acct",
+      "hostname", "addr", "terminal", "msg", "item", "family", "laddr", "lport",
+      "faddr", "fport", "old-auid", "old-ses", "sig", "nargs", "fd0", "fd1", "cap_pi",
+      "cap_pe", "cap_pp", "cap_pa", "old_pp", "old_pi", "old_pe", "new_pp", "new_pi",
+      "new_pe", "path", "scontext", "tcontext", "tclass"
+    };
+    return (id < FID_COUNT) ? names[id] : "";
+  }
+
+  /*
+   * True if two known names share a slot under mult.
+   */
+  static bool slotsCollide(uint32_t mult) {
+    uint8_t slots[256] = {};
+    return !_fillSlots(slots, mult);
+  }
+
+protected:
+  static bool _fillSlots(uint8_t *slots, uint32_t mult) {
+    bool ok = true;
+    for (int id = 1; id < FID_COUNT; id++) {
+      const char *known = name((AuditFieldId)id);
+      uint8_t &slot = slots[(uint32_t)(hash(known, strlen(known)) * mult) >> 24];
+      if (slot != FID_UNKNOWN) {
+        ok = false;
+        continue;
+      }
+      slot = (uint8_t)id;
+    }
+    return ok;
+  }
+
+  struct SlotTable {
+    SlotTable() : slots() {
+      bool ok = _fillSlots(slots, HASH_MULT);
+      assert(ok && "AuditFieldIds::HASH_MULT has a slot collision");
+      (void)ok;
+    }
+    uint8_t slots[256];
+  };
+
+  static const uint8_t *_slots() {
+    static const SlotTable table;
+    return table.slots;
+  }
+};
+
+/*
+ * Set of well-known fields, e.g. the fields an application reads
+ * from one record type.
+ */
+struct AuditFieldSet {
+  AuditFieldSet() : bits_(), count_(0) {}
+
+  AuditFieldSet(std::initializer_list<AuditFieldId> ids) : bits_(), count_(0) {
+    for (auto id : ids) {
+      add(id);
+    }
+  }
+
+  void add(AuditFieldId id) {
+    if (id != FID_UNKNOWN && id < FID_COUNT && !bits_.test(id)) {
+      bits_.set(id);
+      count_++;
+    }
+  }
+
+  bool contains(AuditFieldId id) const {
+    return id != FID_UNKNOWN && id < FID_COUNT && bits_.test(id);
+  }
+
+  size_t size() const {
+    return count_;
+  }
+
+protected:
+  std::bitset<FID_COUNT> bits_;
+  size_t                 count_;
+};
+
+/*
+ * Record type => fields the application needs from it.
+ * Records of a projected type are only indexed for those fields, and
+ * tokenizing stops once all of them have been seen.
+ */
+struct AuditFieldProjection {
+
+  void set(int recType, const AuditFieldSet &fields) {
+    types_[recType] = fields;
+  }
+
+  void remove(int recType) {
+    types_.erase(recType);
+  }
+
+  /*
+   * @return field set for recType or nullptr if not projected.
+   */
+  const AuditFieldSet *get(int recType) const {
+    auto it = types_.find(recType);
+    return (it == types_.end()) ? nullptr : &it->second;
+  }
+
+  bool empty() const {
+    return types_.empty();
+  }
+
+protected:
+  std::map<int, AuditFieldSet> types_;
+};
@@ -1,24 +1,134 @@
 #pragma once
 
 #include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
 #include <list>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <new>
+#include <vector>
+
+/*
+ * Intrusive reference counts.  AuditRefCount is a plain integer, for
+ * objects that may be handed from one thread to another, but are not
+ * shared by two threads at once.  Objects that are should count with
+ * AuditRefCountAtomic.
+ */
+struct AuditRefCount {
+  AuditRefCount() : n_(0) {}
+
+  void     inc() { n_++; }
+  bool     dec() { return --n_ == 0; }  // true if last
+  uint32_t get() const { return n_; }
+
+protected:
+  uint32_t n_;
+};
+
+struct AuditRefCountAtomic {
+  AuditRefCountAtomic() : n_(0) {}
+
+  void     inc() { n_.fetch_add(1, std::memory_order_relaxed); }
+  bool     dec() { return n_.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+  uint32_t get() const { return n_.load(std::memory_order_relaxed); }
+
+protected:
+  std::atomic<uint32_t> n_;
+};
+
+/*
+ * Handle to a heap object T with an intrusive counter member refs_,
+ * deleted with the last handle.  Unlike std::shared_ptr, there is no
+ * separate control block, and copies only touch refs_, which is not
+ * atomic unless T chooses AuditRefCountAtomic.  Moving a handle does
+ * not touch the count at all.
+ */
+template <typename T>
+struct AuditRef {
+  AuditRef() : p_(nullptr) {}
+  AuditRef(std::nullptr_t) : p_(nullptr) {}
+
+  explicit AuditRef(T *p) : p_(p) {
+    if (p_ != nullptr) {
+      p_->refs_.inc();
+    }
+  }
+
+  AuditRef(const AuditRef &other) : AuditRef(other.p_) {}
+
+  AuditRef(AuditRef &&other) : p_(other.p_) {
+    other.p_ = nullptr;
+  }
+
+  ~AuditRef() {
+    reset();
+  }
+
+  AuditRef &operator=(AuditRef other) {
+    std::swap(p_, other.p_);
+    return *this;
+  }
+
+  void reset() {
+    if (p_ != nullptr && p_->refs_.dec()) {
+      delete p_;
+    }
+    p_ = nullptr;
+  }
+
+  T *get() const { return p_; }
+  T *operator->() const { return p_; }
+  T &operator*() const { return *p_; }
+  explicit operator bool() const { return p_ != nullptr; }
+
+  uint32_t useCount() const {
+    return (p_ != nullptr) ? p_->refs_.get() : 0;
+  }
+
+  bool operator==(std::nullptr_t) const { return p_ == nullptr; }
+  bool operator!=(std::nullptr_t) const { return p_ != nullptr; }
+
+protected:
+  T *p_;
+};
 
 #define AUDIT_TYPICAL_BUF_MAXLEN 512
 /*
- * A simple 512 byte buffer that should hold most records.
+ * The record buffer used throughout the library: a netlink header
+ * followed by the message bytes and a terminating null.
+ *
+ * Buffers from AuditRecAllocator own capacity() bytes of storage and
+ * are held by AuditRecordRef.  The smallest size, 512 bytes, should
+ * hold most records; larger ones are pooled by size class.  Contents
+ * are not initialized.  Buffers in an AuditRecArena refer to bytes
+ * the arena owns.
+ *
+ * The class is final, so calls through an AuditRecordBuf pointer are
+ * resolved at compile time and inlined, while it can still be passed
+ * wherever an AuditRecBuf is expected.
  */
-struct AuditTypicalBuf : public AuditRecBuf {
+struct AuditRecordBuf final : public AuditRecBuf {
 
   static const int MAXLEN = AUDIT_TYPICAL_BUF_MAXLEN;
 
-  AuditTypicalBuf(size_t len) : AuditRecBuf(),
-  datavec_( (len <= 512) ? (512 + sizeof(nlmsghdr)) : (len + sizeof(nlmsghdr)) ), len_(0), type_(0) {
+  /*
+   * @param sizeClass AuditRecAllocator size class, -1 if not pooled
+   */
+  AuditRecordBuf(size_t len, int sizeClass = 0) : AuditRecBuf(),
+      capacity_((len <= 512) ? 512 : len), storage_(new char[sizeof(nlmsghdr) + capacity_ + 1]),
+      data_(storage_.get()), len_(0), type_(0), fieldsOffset_(0), sizeClass_(sizeClass), refs_() {
   }
 
-  virtual ~AuditTypicalBuf() {
+  /*
+   * Refers to a header and len bytes of message at data.
+   */
+  AuditRecordBuf(char *data, int type, int len, int offset) : AuditRecBuf(),
+      capacity_(len), storage_(), data_(data), len_(len), type_(type), fieldsOffset_(offset),
+      sizeClass_(-1), refs_() {
   }
 
   int getType() override {
@@ -26,164 +136,875 @@ struct AuditTypicalBuf : public AuditRecBuf {
   }
 
   char *data(bool withHeader) override {
-    return (withHeader ? datavec_.data() : (datavec_.data() + sizeof(nlmsghdr) + fieldsOffset_));
+    return (withHeader ? data_ : (data_ + sizeof(nlmsghdr) + fieldsOffset_));
   };
 
+  char *data() override {
+    return data_ + sizeof(nlmsghdr) + fieldsOffset_;
+  }
+
   size_t size() override {
     return len_ - fieldsOffset_;
   }
 
   size_t capacity() override {
-    return datavec_.size() - sizeof(nlmsghdr);
+    return capacity_;
   }
 
   void setOffset(int offset) override {
     fieldsOffset_ = offset;
   }
 
-  std::vector<char> datavec_;
+  size_t    capacity_;
+  std::unique_ptr<char[]> storage_;  // null if not owned
+  char     *data_;
   int       len_;
   int       type_;
-  int       fieldsOffset_ {0};
+  int       fieldsOffset_;
+  int       sizeClass_;
+  AuditRefCount refs_;
 };
 
+typedef AuditRef<AuditRecordBuf> AuditRecordRef;
+
+// former name of AuditRecordBuf
+typedef AuditRecordBuf AuditTypicalBuf;
+
+/*
+ * Fields parsed out of the value of another field, e.g. msg='...'
+ * in USER_* records.  Keys and value offsets refer to the record
+ * buffer, like the top-level fields.
+ */
+struct AuditRecNestedFields {
+  uint32_t           valueStart;  // of the parent field
+  AuditRecFieldIndex fields;
+};
+
+/*
+ * Chunked bump allocator for per-group scratch data, such as decoded
+ * field values.  Memory is only freed in bulk, by reset().
+ */
+struct AuditScratchArena {
+  enum : size_t { CHUNK_SIZE = 1024 };
+
+  AuditScratchArena() : chunks_(), chunkSize_(0), used_(0) {}
+
+  char *alloc(size_t len) {
+    if (len > chunkSize_ - used_) {
+      // values larger than a chunk get a chunk of their own
+      chunkSize_ = (len > CHUNK_SIZE) ? len : CHUNK_SIZE;
+      chunks_.push_back(std::unique_ptr<char[]>(new char[chunkSize_]));
+      used_ = 0;
+    }
+    char *p = chunks_.back().get() + used_;
+    used_ += len;
+    return p;
+  }
+
+  void reset() {
+    chunks_.clear();
+    chunkSize_ = 0;
+    used_ = 0;
+  }
 
-typedef std::shared_ptr<AuditTypicalBuf> SPAuditTypicalBuf;
+  size_t numChunks() const {
+    return chunks_.size();
+  }
+
+protected:
+  std::vector<std::unique_ptr<char[]> > chunks_;
+  size_t chunkSize_;
+  size_t used_;
+};
+
+/*
+ * Decoded form of a hex-encoded field value.  raw points to the value
+ * in the record buffer, data to the decoded bytes in the group's
+ * scratch arena, or to raw if the value was not hex.
+ */
+struct AuditRecDecodedValue {
+  const char *raw;
+  const char *data;
+  size_t      len;
+};
 
 /*
  * This is a wrapper around a buffer to contain the parsed fields.
+ * The buffer is owned by the group's AuditRecArena.
  */
 struct AuditRecState {
-  AuditRecState(SPAuditRecBuf buf) : spBuf(buf), fields(), isProcessed(false) {}
+  AuditRecState(AuditRecordBuf *b) : buf(b), fields(), isProcessed(false), nested() {}
 
-  SPAuditRecBuf spBuf;
-  std::map<std::string, string_offsets_t> fields;
+  AuditRecordBuf *buf;
+  AuditRecFieldIndex fields;
   bool isProcessed;
+  // expanded on first access
+  std::vector<std::unique_ptr<AuditRecNestedFields> > nested;
+};
+
+/*
+ * Storage for one group: the bytes of all its records, appended to a
+ * few large chunks, their parse state, and scratch memory for decoded
+ * values.  Groups take an arena from AuditRecAllocator::allocArena()
+ * and hand it back whole with recycleArena().  Chunks and vector
+ * capacity are kept for the next group, so a steady stream of events
+ * allocates nothing per record.
+ */
+struct AuditRecArena {
+  enum : size_t { CHUNK_SIZE = 8192, MAX_CHUNKS_KEPT = 4, TYPICAL_RECORDS = 8 };
+
+  AuditRecArena() : records(), scratch(), decoded(), extractSlots(), extractNames(),
+                    chunks_(), chunk_(0), used_(0) {
+    records.reserve(TYPICAL_RECORDS);
+  }
+
+  ~AuditRecArena() {
+    reset();
+  }
+
+  /*
+   * Copies netlink header and msglen bytes of message into the arena.
+   * @return record buffer, valid until reset()
+   */
+  AuditRecordBuf *append(const char *paudit_message, int type, int msglen, int preamble_size) {
+    const size_t objsize = _align(sizeof(AuditRecordBuf));
+    char *p = _alloc(objsize + sizeof(nlmsghdr) + msglen + 1);
+    char *data = p + objsize;
+    memcpy(data, paudit_message, msglen + sizeof(nlmsghdr));
+    data[sizeof(nlmsghdr) + msglen] = 0;
+    AuditRecordBuf *buf = new (p) AuditRecordBuf(data, type, msglen, preamble_size);
+    records.push_back(AuditRecState(buf));
+    return buf;
+  }
+
+  /*
+   * Drops all records, keeping chunks and capacity for reuse.
+   */
+  void reset() {
+    for (auto &rec : records) {
+      rec.buf->~AuditRecordBuf();
+    }
+    records.clear();
+    decoded.clear();
+    scratch.reset();
+    while (chunks_.size() > MAX_CHUNKS_KEPT || (!chunks_.empty() && chunks_.back().size > CHUNK_SIZE)) {
+      chunks_.pop_back();
+    }
+    chunk_ = 0;
+    used_ = 0;
+  }
+
+  size_t numChunks() const {
+    return chunks_.size();
+  }
+
+  std::vector<AuditRecState> records;
+
+  // decoded path values
+  AuditScratchArena scratch;
+  std::vector<AuditRecDecodedValue> decoded;
+
+  // working state of AuditRecGroup::extractFields(), by slot and by spec
+  struct ExtractSlot {
+    uint32_t first;   // index of the slot's first spec
+    uint32_t winner;  // index of the spec that filled it, or count
+  };
+  struct ExtractName {
+    uint32_t len;
+    uint32_t hash;
+  };
+  std::vector<ExtractSlot> extractSlots;
+  std::vector<ExtractName> extractNames;
+
+protected:
+  struct Chunk {
+    std::unique_ptr<char[]> data;
+    size_t                  size;
+  };
+
+  static size_t _align(size_t n) {
+    return (n + 15) & ~(size_t)15;
+  }
+
+  char *_alloc(size_t len) {
+    len = _align(len);
+    while (chunk_ < chunks_.size() && len > chunks_[chunk_].size - used_) {
+      chunk_++;
+      used_ = 0;
+    }
+    if (chunk_ == chunks_.size()) {
+      Chunk chunk;
+      chunk.size = (len > CHUNK_SIZE) ? len : CHUNK_SIZE;
+      chunk.data.reset(new char[chunk.size]);
+      chunks_.push_back(std::move(chunk));
+    }
+    char *p = chunks_[chunk_].data.get() + used_;
+    used_ += len;
+    return p;
+  }
+
+  std::vector<Chunk> chunks_;
+  size_t             chunk_;  // current
+  size_t             used_;
+};
+
+typedef std::shared_ptr<AuditRecArena> SPAuditRecArena;
+
+/*
+ * Bounded lock-free multi-producer multi-consumer queue, after
+ * Dmitry Vyukov's design.  Each cell carries a sequence number that
+ * tells producers and consumers whose turn it is, so the value in a
+ * cell is only touched by the thread that claimed it.
+ */
+template <typename T>
+struct AuditMPMCQueue {
+
+  /*
+   * @param capacity rounded up to a power of 2
+   */
+  explicit AuditMPMCQueue(size_t capacity) : mask_(_roundUp(capacity) - 1),
+      cells_(new Cell[mask_ + 1]), pad0_(), head_(0), pad1_(), tail_(0) {
+    for (size_t i = 0; i <= mask_; i++) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /*
+   * Moves value into the queue.
+   * @return false if full, value is left as is.
+   */
+  bool push(T &value) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells_[pos & mask_];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.value = std::move(value);
+          cell.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /*
+   * @return false if empty.
+   */
+  bool pop(T &dest) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells_[pos & mask_];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          dest = std::move(cell.value);
+          cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  size_t capacity() const {
+    return mask_ + 1;
+  }
+
+  /*
+   * @return number of items, exact only when no push or pop is in progress.
+   */
+  size_t size() const {
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    return (tail > head) ? tail - head : 0;
+  }
+
+protected:
+  struct Cell {
+    std::atomic<size_t> seq;
+    T                   value;
+  };
+
+  static size_t _roundUp(size_t n) {
+    size_t cap = 2;
+    while (cap < n) {
+      cap <<= 1;
+    }
+    return cap;
+  }
+
+  const size_t             mask_;
+  std::unique_ptr<Cell[]>  cells_;
+  // producers and consumers on separate cache lines
+  char                     pad0_[64];
+  std::atomic<size_t>      head_;
+  char                     pad1_[64];
+  std::atomic<size_t>      tail_;
 };
 
 /*
  * Manages a pool of audit_reply objects, as well as
  * smaller ones used for consolidation.
+ *
+ * Buffers come in power-of-2 size classes, 512 bytes up to 8192, and a
+ * last class of MAX_AUDIT_MESSAGE_LENGTH.  A message gets a buffer of
+ * the smallest class that holds it.  Each class has its own pool,
+ * limit and statistics.
+ *
+ * Free buffers sit in a per-thread cache in front of a shared
+ * lock-free queue per class.  alloc() and recycle() normally only
+ * touch the calling thread's cache; buffers move between a cache and
+ * the shared queue in batches, e.g. when the consumer thread calling
+ * release() has recycled a batch, or the reader thread has run out.
+ * A thread caches buffers of up to THREAD_CACHES allocators at a time,
+ * so a thread serving several collectors keeps a cache for each.
+ * Using one more hands the buffers of the least recently added cache
+ * back to its allocator, and so does thread exit.
  */
 struct AuditRecAllocator {
 //  static const int DEFAULT_MAX_REPLY_BUFS = 50;
 //  static const int DEFAULT_MAX_SMALL_BUFS = 500;
+  enum : size_t { MAX_CACHED = 32, SHARED_CAPACITY = 1024, ARENAS_KEPT = 64, THREAD_CACHES = 4 };
+  enum : int { NUM_CLASSES = 6 };
+
+  struct Stats {
+    size_t   capacity;      // bytes per buffer
+    size_t   maxPoolSize;   // 0 if unlimited
+    size_t   numAllocated;  // when limited
+    size_t   numFree;
+    uint64_t numReused;     // allocs served from the pool
+    uint64_t numCreated;    // allocs that created a buffer
+    uint64_t numFailed;     // allocs refused by the limit
+    uint64_t numDropped;    // recycled buffers freed for lack of room
+  };
 
   /**
    * @param max_pool_size_small If 0, the smaller buffers will not
    *                            be pooled, only allocated shared_ptr.
    *                            Otherwise, sets a limit on number of
    *                            allocated shared_ptr.
+   * @param max_pool_size_large Same, for each of the larger classes.
+   *                            Defaults to a quarter of max_pool_size.
    */
-  AuditRecAllocator(size_t max_pool_size) : pool_(),
-      mutex_(), max_pool_size_(max_pool_size) {
+  AuditRecAllocator(size_t max_pool_size, size_t max_pool_size_large = (size_t)-1) :
+      shared_(std::make_shared<Shared>(max_pool_size,
+          (max_pool_size_large != (size_t)-1) ? max_pool_size_large : (max_pool_size + 3) / 4)) {
       }
   virtual ~AuditRecAllocator() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    num_ = 0;
-    pool_.clear();
   }
 
+  /**
+   * Allocates a buffer, copies message data and headers.
+   * @returns nullptr if the limit of its size class is reached
+   */
+  AuditRecordRef allocRecord(struct audit_message &temp, int type, int msglen, int preamble_size = 0) {
+    AuditRecordRef ref = _get(msglen);
+    if (!ref) {
+      return nullptr;
+    }
+
+    _copyContents((char *)&temp, type, msglen, *ref);
+    ref->setOffset(preamble_size);
+
+    return ref;
+  }
+
+  /**
+   * Allocates a new buffer, copies message data and headers of orig,
+   * which may be any AuditRecBuf implementation.
+   * @returns nullptr if the limit of its size class is reached
+   */
+  AuditRecordRef duplicateRecord(AuditRecBuf &orig) {
+    AuditRecordRef ref = _get(orig.size());
+    if (!ref) {
+      return nullptr;
+    }
+
+    _copyContents(orig, *ref);
+
+    return ref;
+  }
+
+  /**
+   * Puts buffer back in pool, unless other handles to it remain.
+   * ref is reset.
+   */
+  void recycle(AuditRecordRef &ref) {
+    if (ref.useCount() == 1) {
+      _recycle(ref);
+    }
+    ref.reset();
+  }
+
+  /*
+   * std::shared_ptr forms of the above, for code written against the
+   * AuditRecBuf interface.  Each buffer handed out this way costs a
+   * shared_ptr control block allocation.
+   */
+
   SPAuditRecBuf alloc(struct audit_message &temp, int type, int msglen, int preamble_size = 0) {
-    std::lock_guard<std::mutex> lock(mutex_);
-
-    SPAuditTypicalBuf spBuf;
-    if (msglen <= AuditTypicalBuf::MAXLEN && !pool_.empty()) {
-      spBuf = std::static_pointer_cast<AuditTypicalBuf>(pool_.front());
-      pool_.pop_front();
-    } else {
-      if (max_pool_size_ > 0) {
-        if (num_ >= max_pool_size_) {
-          return nullptr;
-        }
-        num_++;
+    return _share(allocRecord(temp, type, msglen, preamble_size));
+  }
+
+  SPAuditRecBuf duplicate(const SPAuditRecBuf &orig) {
+    return _share(duplicateRecord(*orig));
+  }
+
+  /**
+   * Puts buffer from alloc() or duplicate() back in pool.  Other
+   * buffers are left alone.  obj and its copies must not be used
+   * afterwards.
+   */
+  void recycle(const SPAuditRecBuf &obj)  {
+    SharedDeleter *deleter = std::get_deleter<SharedDeleter>(obj);
+    if (deleter != nullptr) {
+      recycle(deleter->ref);
+    }
+  }
+
+  /**
+   * @return number of free buffers of all classes, in the shared
+   * queues and in thread caches.
+   */
+  size_t poolSize() {
+    size_t n = 0;
+    for (int cls = 0; cls < NUM_CLASSES; cls++) {
+      n += shared_->pools[cls]->numFree.load(std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> lock(shared_->cachesMutex);
+    for (auto cache : shared_->caches) {
+      for (int cls = 0; cls < NUM_CLASSES; cls++) {
+        n += cache->count[cls].load(std::memory_order_relaxed);
+      }
+    }
+    return n;
+  }
+
+  Stats getStats(int cls) const {
+    const Pool &pool = *shared_->pools[cls];
+    Stats stats;
+    stats.capacity = classCapacity(cls);
+    stats.maxPoolSize = pool.maxSize;
+    stats.numAllocated = pool.num.load(std::memory_order_relaxed);
+    stats.numFree = pool.numFree.load(std::memory_order_relaxed);
+    stats.numReused = pool.numReused.load(std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock(shared_->cachesMutex);
+      for (auto cache : shared_->caches) {
+        stats.numFree += cache->count[cls].load(std::memory_order_relaxed);
+        stats.numReused += cache->reused[cls].load(std::memory_order_relaxed);
+      }
+    }
+    stats.numCreated = pool.numCreated.load(std::memory_order_relaxed);
+    stats.numFailed = pool.numFailed.load(std::memory_order_relaxed);
+    stats.numDropped = pool.numDropped.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  static size_t classCapacity(int cls) {
+    return (cls == NUM_CLASSES - 1) ? (size_t)MAX_AUDIT_MESSAGE_LENGTH : ((size_t)AuditTypicalBuf::MAXLEN << cls);
+  }
+
+  /*
+   * @return smallest class holding len bytes, or -1 if len exceeds
+   * MAX_AUDIT_MESSAGE_LENGTH.
+   */
+  static int sizeClassOf(size_t len) {
+    for (int cls = 0; cls < NUM_CLASSES; cls++) {
+      if (len <= classCapacity(cls)) {
+        return cls;
       }
-      spBuf = std::make_shared<AuditTypicalBuf>(msglen);
     }
+    return -1;
+  }
 
-    _copyContents((char *)&temp, type, msglen, spBuf);
-    spBuf->setOffset(preamble_size);
+  /**
+   * @return empty group arena, from the pool if possible, or nullptr
+   * if max_pool_size arenas are in use.
+   */
+  SPAuditRecArena allocArena() {
+    Shared &shared = *shared_;
+    const size_t maxArenas = shared.pools[0]->maxSize;
+    if (shared.numArenas.fetch_add(1, std::memory_order_relaxed) >= maxArenas && maxArenas > 0) {
+      shared.numArenas.fetch_sub(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    SPAuditRecArena spArena;
+    if (!shared.arenas.pop(spArena)) {
+      spArena = std::make_shared<AuditRecArena>();
+    }
+    return spArena;
+  }
 
-    return spBuf;
+  /**
+   * Takes back the arena of a released group.  If its records are
+   * still referenced, e.g. through AuditRecGroup::getMessage(), the
+   * arena is left to the last holder instead.
+   */
+  void recycleArena(SPAuditRecArena &spArena) {
+    shared_->numArenas.fetch_sub(1, std::memory_order_relaxed);
+    if (spArena.use_count() == 1) {
+      spArena->reset();
+      shared_->arenas.push(spArena);
+    }
+    spArena.reset();
   }
 
   /**
-   * Allocates a new buffer, copies message data and headers.
-   * @returns nullptr if reached max_pool_size_small
-   */
-  SPAuditRecBuf duplicate(SPAuditRecBuf orig) {
-    std::lock_guard<std::mutex> lock(mutex_);
-
-    SPAuditTypicalBuf spBuf;
-    if (!pool_.empty()) {
-      spBuf = std::static_pointer_cast<AuditTypicalBuf>(pool_.front());
-      pool_.pop_front();
-    } else {
-      if (max_pool_size_ > 0) {
-        if (num_ >= max_pool_size_) {
-          return nullptr;
+   * @return number of free arenas
+   */
+  size_t arenaPoolSize() {
+    return shared_->arenas.size();
+  }
+
+protected:
+
+  struct Pool {
+    Pool(size_t max_pool_size) : freeList((max_pool_size > 0) ? max_pool_size : SHARED_CAPACITY),
+        maxSize(max_pool_size), cacheLimit(_cacheLimit(max_pool_size)), num(0), numFree(0),
+        numReused(0), numCreated(0), numFailed(0), numDropped(0) {}
+
+    AuditMPMCQueue<AuditRecordRef> freeList;
+    const size_t                   maxSize;
+    const size_t                   cacheLimit;
+    std::atomic<size_t>            num;      // allocated, when limited
+    // in freeList, thread caches count their own and their reuses,
+    // so the alloc and recycle fast paths do no atomic updates
+    std::atomic<size_t>            numFree;
+    std::atomic<uint64_t>          numReused;
+    std::atomic<uint64_t>          numCreated;
+    std::atomic<uint64_t>          numFailed;
+    std::atomic<uint64_t>          numDropped;
+  };
+
+  /*
+   * Owns the buffer of a shared_ptr from alloc() or duplicate().
+   */
+  struct SharedDeleter {
+    void operator()(AuditRecBuf *) {
+      ref.reset();
+    }
+
+    AuditRecordRef ref;
+  };
+
+  static SPAuditRecBuf _share(AuditRecordRef ref) {
+    if (!ref) {
+      return nullptr;
+    }
+    AuditRecBuf *p = ref.get();
+    SharedDeleter deleter;
+    deleter.ref = std::move(ref);
+    return SPAuditRecBuf(p, std::move(deleter));
+  }
+
+  struct ThreadCache;
+
+  /*
+   * Pool state, shared with the thread caches holding its buffers
+   */
+  struct Shared {
+    Shared(size_t max_pool_size, size_t max_pool_size_large) : id(_nextId()), arenas(ARENAS_KEPT),
+        numArenas(0) {
+      pools[0].reset(new Pool(max_pool_size));
+      for (int cls = 1; cls < NUM_CLASSES; cls++) {
+        pools[cls].reset(new Pool(max_pool_size_large));
+      }
+    }
+
+    static uint64_t _nextId() {
+      static std::atomic<uint64_t> next(1);
+      return next.fetch_add(1);
+    }
+
+    const uint64_t                  id;
+    std::unique_ptr<Pool>           pools[NUM_CLASSES];
+    AuditMPMCQueue<SPAuditRecArena> arenas;
+    std::atomic<size_t>             numArenas;  // in use
+    std::mutex                      cachesMutex;
+    std::vector<ThreadCache *>      caches;     // holding buffers of this allocator
+  };
+
+  /*
+   * count and reused are only written by the owning thread, and read
+   * by poolSize() and getStats().
+   */
+  struct ThreadCache {
+    ThreadCache() : ownerId(0), owner() {
+      for (int cls = 0; cls < NUM_CLASSES; cls++) {
+        count[cls].store(0);
+        reused[cls].store(0);
+      }
+    }
+    ~ThreadCache() {
+      flush();
+    }
+
+    /*
+     * Returns cached buffers to the owner's shared queues, or drops
+     * them if the owner is gone.
+     */
+    void flush() {
+      std::shared_ptr<Shared> spOwner = owner.lock();
+      if (spOwner != nullptr) {
+        std::lock_guard<std::mutex> lock(spOwner->cachesMutex);
+        auto &caches = spOwner->caches;
+        caches.erase(std::remove(caches.begin(), caches.end(), this), caches.end());
+      }
+      for (int cls = 0; cls < NUM_CLASSES; cls++) {
+        Pool *pool = (spOwner != nullptr) ? spOwner->pools[cls].get() : nullptr;
+        size_t n = count[cls].load(std::memory_order_relaxed);
+        if (pool != nullptr) {
+          pool->numReused.fetch_add(reused[cls].load(std::memory_order_relaxed), std::memory_order_relaxed);
         }
-        num_++;
+        _release(pool, bufs[cls], n);
+        count[cls].store(0, std::memory_order_relaxed);
+        reused[cls].store(0, std::memory_order_relaxed);
       }
-      spBuf = std::make_shared<AuditTypicalBuf>(orig->size());
+      ownerId = 0;
+      owner.reset();
     }
 
-    _copyContents(orig, spBuf);
+    uint64_t               ownerId;
+    std::weak_ptr<Shared>  owner;
+    std::atomic<size_t>    count[NUM_CLASSES];
+    std::atomic<uint64_t>  reused[NUM_CLASSES];
+    AuditRecordRef         bufs[NUM_CLASSES][MAX_CACHED];
+  };
+
+  struct ThreadCaches {
+    ThreadCaches() : last(0), victim(0) {}
+
+    ThreadCache caches[THREAD_CACHES];
+    size_t      last;     // most recently used
+    size_t      victim;   // next to hand back when all are in use
+  };
 
-    return spBuf;
+  static ThreadCaches &_caches() {
+    static thread_local ThreadCaches caches;
+    return caches;
   }
 
-  size_t poolSize() {
-    return pool_.size();
+  /*
+   * @return cache of the calling thread, holding buffers of this allocator.
+   */
+  ThreadCache &_myCache() {
+    ThreadCaches &caches = _caches();
+    const uint64_t id = shared_->id;
+    if (caches.caches[caches.last].ownerId == id) {
+      return caches.caches[caches.last];
+    }
+    size_t i = 0;
+    while (i < THREAD_CACHES && caches.caches[i].ownerId != id) {
+      i++;
+    }
+    if (i == THREAD_CACHES) {
+      // take a free cache, or one whose allocator is gone, else evict
+      i = 0;
+      while (i < THREAD_CACHES && caches.caches[i].ownerId != 0 && !caches.caches[i].owner.expired()) {
+        i++;
+      }
+      if (i == THREAD_CACHES) {
+        i = caches.victim++ % THREAD_CACHES;
+      }
+      ThreadCache &cache = caches.caches[i];
+      cache.flush();
+      cache.ownerId = id;
+      cache.owner = shared_;
+      std::lock_guard<std::mutex> lock(shared_->cachesMutex);
+      shared_->caches.push_back(&cache);
+    }
+    caches.last = i;
+    return caches.caches[i];
   }
 
-  /**
-   * Puts buffer back in pool
+  /*
+   * @return buffer holding len bytes, from the pool if possible, or
+   * nullptr if the limit of its class is reached.
    */
-  void recycle(SPAuditRecBuf obj)  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    _recycle(obj);
+  AuditRecordRef _get(size_t len) {
+    int cls = sizeClassOf(len);
+    if (cls < 0) {
+      // too large to pool
+      return AuditRecordRef(new AuditRecordBuf(len, -1));
+    }
+    Pool &pool = *shared_->pools[cls];
+    AuditRecordRef ref = _take(cls);
+    if (ref) {
+      return ref;
+    }
+    if (!_reserve(pool)) {
+      pool.numFailed.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    pool.numCreated.fetch_add(1, std::memory_order_relaxed);
+    return AuditRecordRef(new AuditRecordBuf(classCapacity(cls), cls));
   }
 
-protected:
-  void _recycle(SPAuditRecBuf obj)  {
-    if (obj->size() > AuditTypicalBuf::MAXLEN) {
+  /*
+   * @return free buffer of class cls or nullptr
+   */
+  AuditRecordRef _take(int cls) {
+    Pool &pool = *shared_->pools[cls];
+    AuditRecordRef ref;
+    if (pool.cacheLimit == 0) {
+      if (!pool.freeList.pop(ref)) {
+        return nullptr;
+      }
+      pool.numFree.fetch_sub(1, std::memory_order_relaxed);
+      pool.numReused.fetch_add(1, std::memory_order_relaxed);
+      return ref;
+    }
+    ThreadCache &cache = _myCache();
+    size_t count = cache.count[cls].load(std::memory_order_relaxed);
+    AuditRecordRef *bufs = cache.bufs[cls];
+    if (count == 0) {
+      // refill half the cache
+      while (count < pool.cacheLimit / 2 && pool.freeList.pop(bufs[count])) {
+        count++;
+      }
+      if (count == 0) {
+        return nullptr;
+      }
+      pool.numFree.fetch_sub(count, std::memory_order_relaxed);
+    }
+    ref = std::move(bufs[--count]);
+    cache.count[cls].store(count, std::memory_order_relaxed);
+    cache.reused[cls].store(cache.reused[cls].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return ref;
+  }
+
+  /*
+   * Counts a new buffer against the limit of its class.
+   * @return false if the limit is reached.
+   */
+  static bool _reserve(Pool &pool) {
+    if (pool.maxSize == 0) {
+      return true;
+    }
+    if (pool.num.fetch_add(1, std::memory_order_relaxed) >= pool.maxSize) {
+      pool.num.fetch_sub(1, std::memory_order_relaxed);
+      return false;
+    }
+    return true;
+  }
+
+  /*
+   * Moves ref into the pool of its class.
+   */
+  void _recycle(AuditRecordRef &ref)  {
+    const int cls = ref->sizeClass_;
+    if (cls < 0) {
       // don't pool these, just let them get cleaned up
-    } else {
-      auto sp = std::static_pointer_cast<AuditTypicalBuf>(obj);
-      sp->len_ = 0;
-      sp->type_ = 0;
-      pool_.push_back(obj);
+      return;
     }
+    ref->len_ = 0;
+    ref->type_ = 0;
+    ref->fieldsOffset_ = 0;
+    Pool &pool = *shared_->pools[cls];
+
+    if (pool.cacheLimit == 0) {
+      _release(&pool, &ref, 1);
+      return;
+    }
+    ThreadCache &cache = _myCache();
+    size_t count = cache.count[cls].load(std::memory_order_relaxed);
+    AuditRecordRef *bufs = cache.bufs[cls];
+    if (count == pool.cacheLimit) {
+      // hand the older half to the shared queue
+      size_t half = pool.cacheLimit / 2;
+      size_t n = 0;
+      _release(&pool, bufs, half);
+      for (size_t i = half; i < count; i++) {
+        bufs[n++] = std::move(bufs[i]);
+      }
+      count = n;
+    }
+    bufs[count++] = std::move(ref);
+    cache.count[cls].store(count, std::memory_order_relaxed);
   }
 
-  void _copyContents(SPAuditRecBuf orig, SPAuditTypicalBuf dest) {
-    _copyContents(orig->data(true), orig->getType(), orig->size(), dest);
+  /*
+   * Moves n buffers to the shared queue of pool, or drops them if
+   * pool is gone or there is no room.
+   */
+  static void _release(Pool *pool, AuditRecordRef *bufs, size_t n) {
+    if (n == 0) {
+      return;
+    }
+    if (pool != nullptr) {
+      pool->numFree.fetch_add(n, std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (pool == nullptr || !pool->freeList.push(bufs[i])) {
+        if (pool != nullptr) {
+          pool->numFree.fetch_sub(1, std::memory_order_relaxed);
+        }
+        _drop(pool, bufs[i]);
+      }
+    }
+  }
+
+  /*
+   * Frees a pooled buffer there is no room for.
+   */
+  static void _drop(Pool *pool, AuditRecordRef &ref) {
+    ref.reset();
+    if (pool != nullptr) {
+      pool->numDropped.fetch_add(1, std::memory_order_relaxed);
+      if (pool->maxSize > 0) {
+        pool->num.fetch_sub(1, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /*
+   * Caching more than a small share of max_pool_size would leave
+   * other threads short.
+   */
+  static size_t _cacheLimit(size_t max_pool_size) {
+    if (max_pool_size == 0) {
+      return MAX_CACHED;
+    }
+    size_t limit = max_pool_size / 16;
+    return (limit < 2) ? 0 : (limit > MAX_CACHED) ? MAX_CACHED : limit;
+  }
+
+  void _copyContents(AuditRecBuf &orig, AuditRecordBuf &dest) {
+    _copyContents(orig.data(true), orig.getType(), orig.size(), dest);
   }
 
-  void _copyContents(char *paudit_message, int msgtype, int msglen, SPAuditTypicalBuf dest) {
+  void _copyContents(char *paudit_message, int msgtype, int msglen, AuditRecordBuf &dest) {
     
-    if (msglen < 26 || msglen > dest->capacity()) {
+    if (msglen < 26 || (size_t)msglen > dest.capacity()) {
       assert(false);
       return;
     }
     
     // copy over header + message data
     
-    memcpy(dest->data(true), paudit_message, msglen + (int)sizeof(nlmsghdr));
+    memcpy(dest.data(true), paudit_message, msglen + (int)sizeof(nlmsghdr));
     
-    dest->type_ = msgtype;
-    dest->len_ = msglen;
+    dest.type_ = msgtype;
+    dest.len_ = msglen;
+    dest.fieldsOffset_ = 0;
     
     // make sure it's null-terminated
     
-    dest->data(false)[dest->len_] = 0;
+    dest.data(false)[dest.len_] = 0;
   }
 
-  
-  std::list<SPAuditRecBuf> pool_;
-  std::mutex mutex_;
-  uint32_t num_ {0};
-  size_t max_pool_size_;
+
+  std::shared_ptr<Shared> shared_;
 };
 typedef std::shared_ptr<AuditRecAllocator> SPAuditRecAllocator;
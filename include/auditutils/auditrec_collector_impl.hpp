@@ -6,21 +6,45 @@
 class AuditRecGroupImpl : public AuditRecGroup {
 public:
 
-  AuditRecGroupImpl(std::string serial, int64_t tsec, int32_t tms, SPAuditRecAllocator a) :
-    AuditRecGroup(), header_(), records_(), allocator_(a) {
+  AuditRecGroupImpl(uint64_t serial, uint64_t tsec, uint32_t tms, SPAuditRecAllocator a,
+                    std::shared_ptr<const AuditRecParsers> parsers,
+                    std::shared_ptr<const AuditFieldProjection> projection = nullptr) :
+    AuditRecGroup(), header_(), allocator_(a), arena_(_emptyArena()), parsers_(parsers), projection_(projection) {
     header_.serial = serial;
     header_.tsec = tsec;
     header_.tms = tms;
   }
 
   virtual ~AuditRecGroupImpl() {
+    release();
   }
 
-  void add(SPAuditRecBuf sp) {
-    records_.push_back(AuditRecState(sp));
+  /*
+   * Copies record into the group arena.
+   * @return false if no arena is available.
+   */
+  bool add(struct audit_message &temp, int type, int msglen, int preamble_size) {
+    if (!_acquireArena()) {
+      return false;
+    }
+    arena_->append((const char *)&temp, type, msglen, preamble_size);
+    return true;
+  }
+
+  bool add(const SPAuditRecBuf &sp) {
+    if (!_acquireArena()) {
+      return false;
+    }
+    int offset = (int)(sp->data(false) - sp->data(true) - sizeof(nlmsghdr));
+    arena_->append(sp->data(true), sp->getType(), offset + (int)sp->size(), offset);
+    return true;
   }
 
   std::string getSerial() override {
+    return std::to_string(header_.serial);
+  }
+
+  uint64_t getSerialNumber() override {
     return header_.serial;
   }
 
@@ -37,12 +61,13 @@ public:
   }
 
   size_t getNumMessages() override {
-    return records_.size();
+    return arena_->records.size();
   }
 
   SPAuditRecBuf getMessage(int i) override {
-    if (i < 0 || i > records_.size()) return nullptr;
-    return records_[i].spBuf;
+    if (i < 0 || (size_t)i >= arena_->records.size()) return nullptr;
+    // shares ownership of the arena, no allocation
+    return SPAuditRecBuf(arena_, arena_->records[i].buf);
   }
 
   // get by type. e.g. AUDIT_EXECVE
@@ -51,7 +76,7 @@ public:
     if (nullptr == p) {
       return nullptr;
     }
-    return p->spBuf;
+    return SPAuditRecBuf(arena_, p->buf);
   }
 
 
@@ -59,136 +84,636 @@ public:
    * return type of first record or 0.
    */
   int getType() override {
-    if (records_.empty()) return 0;
-    return records_[0].spBuf->getType();
+    if (arena_->records.empty()) return 0;
+    return arena_->records[0].buf->getType();
   }
 
   /*
    * return true if found
    */
-  bool getField(const std::string &name, std::string &dest, std::string defaultValue, int recType=0, int nth=0) override {
+  bool getField(const std::string &name, std::string &dest, const std::string &defaultValue, int recType=0, int nth=0) override {
 
-    // TODO: support nth value
+    const string_offsets_t *entry;
+    const char *value = _findField(name, recType, nth, entry);
+    return _getString(value, entry, dest, defaultValue);
+  }
 
-    for (int i=0; i < records_.size(); i++) {
-      auto &prec = records_[i].spBuf;
-      if (recType != 0 && prec->getType() != recType) {
-        continue;
-      }
-      if (!records_[i].isProcessed) {
-        AuditRecParsers::getInstance().parseFields(prec->getType(), prec->data(),
-                                        prec->size(),
-                                        records_[i].fields);
-        records_[i].isProcessed = true;
-      }
-      auto fit = records_[i].fields.find(name);
-      if (fit != records_[i].fields.end()) {
-        dest = std::string(prec->data() + fit->second.start, fit->second.len);
-        return true;
-      }
-    }
-    dest = defaultValue;
-    return false;
+  bool getField(AuditFieldId id, std::string &dest, const std::string &defaultValue, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(id, recType, nth, entry);
+    return _getString(value, entry, dest, defaultValue);
   }
 
   /*
-   * return true if found
+   * return true if found.
+   * Unquoted values that are not valid hex are returned verbatim.
    */
-  bool getPathField(const std::string &name, std::string &dest, std::string defaultValue, int recType=0, int nth=0) override {
+  bool getPathField(const std::string &name, std::string &dest, const std::string &defaultValue, int recType=0, int nth=0) override {
 
-    // TODO: support nth value
+    const string_offsets_t *entry;
+    const char *value = _findField(name, recType, nth, entry);
+    return _getPath(value, entry, dest, defaultValue);
+  }
 
-    for (int i=0; i < records_.size(); i++) {
-      auto &prec = records_[i].spBuf;
-      if (recType != 0 && prec->getType() != recType) {
-        continue;
+  bool getPathField(AuditFieldId id, std::string &dest, const std::string &defaultValue, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(id, recType, nth, entry);
+    return _getPath(value, entry, dest, defaultValue);
+  }
+
+  int getFieldInt(const std::string &name, int64_t &dest, int64_t defaultValue, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(name, recType, nth, entry);
+    return _getInt(value, entry, dest, defaultValue);
+  }
+
+  int getFieldInt(AuditFieldId id, int64_t &dest, int64_t defaultValue, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(id, recType, nth, entry);
+    return _getInt(value, entry, dest, defaultValue);
+  }
+
+  int getFieldUInt(const std::string &name, uint64_t &dest, uint64_t defaultValue, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(name, recType, nth, entry);
+    return _getUInt(value, entry, dest, defaultValue);
+  }
+
+  int getFieldUInt(AuditFieldId id, uint64_t &dest, uint64_t defaultValue, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(id, recType, nth, entry);
+    return _getUInt(value, entry, dest, defaultValue);
+  }
+
+  int getFieldHex(const std::string &name, uint64_t &dest, uint64_t defaultValue, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(name, recType, nth, entry);
+    return _getHex(value, entry, dest, defaultValue);
+  }
+
+  int getFieldHex(AuditFieldId id, uint64_t &dest, uint64_t defaultValue, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(id, recType, nth, entry);
+    return _getHex(value, entry, dest, defaultValue);
+  }
+
+  bool getFieldView(const std::string &name, AuditFieldView &dest, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(name, recType, nth, entry);
+    return _getView(value, entry, dest);
+  }
+
+  bool getFieldView(AuditFieldId id, AuditFieldView &dest, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(id, recType, nth, entry);
+    return _getView(value, entry, dest);
+  }
+
+  bool getPathFieldView(const std::string &name, AuditFieldView &dest, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(name, recType, nth, entry);
+    return _getPathView(value, entry, dest);
+  }
+
+  bool getPathFieldView(AuditFieldId id, AuditFieldView &dest, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(id, recType, nth, entry);
+    return _getPathView(value, entry, dest);
+  }
+
+  bool getPathField(const std::string &name, char *dest, size_t destsize, size_t &destlen, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(name, recType, nth, entry);
+    return _getPathInto(value, entry, dest, destsize, destlen);
+  }
+
+  bool getPathField(AuditFieldId id, char *dest, size_t destsize, size_t &destlen, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(id, recType, nth, entry);
+    return _getPathInto(value, entry, dest, destsize, destlen);
+  }
+
+  bool getDecodedField(const std::string &name, std::string &dest, const std::string &defaultValue, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(name, recType, nth, entry);
+    bool decode = _isEncodedField(value, AuditFieldIds::lookup(name.data(), name.size()), name.c_str());
+    return _getDecoded(value, entry, decode, dest, defaultValue);
+  }
+
+  bool getDecodedField(AuditFieldId id, std::string &dest, const std::string &defaultValue, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(id, recType, nth, entry);
+    bool decode = _isEncodedField(value, id, nullptr);
+    return _getDecoded(value, entry, decode, dest, defaultValue);
+  }
+
+  bool getDecodedFieldView(const std::string &name, AuditFieldView &dest, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(name, recType, nth, entry);
+    bool decode = _isEncodedField(value, AuditFieldIds::lookup(name.data(), name.size()), name.c_str());
+    return _getDecodedView(value, entry, decode, dest);
+  }
+
+  bool getDecodedFieldView(AuditFieldId id, AuditFieldView &dest, int recType=0, int nth=0) override {
+    const string_offsets_t *entry;
+    const char *value = _findField(id, recType, nth, entry);
+    bool decode = _isEncodedField(value, id, nullptr);
+    return _getDecodedView(value, entry, decode, dest);
+  }
+
+  size_t extractFields(const AuditFieldSpec *specs, size_t count, AuditFieldValue *row) override {
+    size_t numSlots = 0;
+    for (size_t s=0; s < count; s++) {
+      row[specs[s].slot].status = AuditParseUtils::NUM_OK;
+    }
+    for (size_t s=0; s < count; s++) {
+      AuditFieldValue &slot = row[specs[s].slot];
+      if (slot.status != AuditParseUtils::NUM_NOT_FOUND) {
+        slot.status = AuditParseUtils::NUM_NOT_FOUND;
+        numSlots++;
       }
-      if (!records_[i].isProcessed) {
-        AuditRecParsers::getInstance().parseFields(prec->getType(), prec->data(),
-                                        prec->size(),
-                                        records_[i].fields);
-        records_[i].isProcessed = true;
+    }
+    if (arena_->records.empty()) {
+      // the shared empty arena has no working state
+      return numSlots;
+    }
+
+    // a slot is final once its first spec matched
+    auto &slots = arena_->extractSlots;
+    auto &names = arena_->extractNames;
+    slots.clear();
+    names.resize(count);
+    for (size_t s=0; s < count; s++) {
+      const AuditFieldSpec &spec = specs[s];
+      if (spec.slot >= slots.size()) {
+        AuditRecArena::ExtractSlot unused = { (uint32_t)count, (uint32_t)count };
+        slots.resize(spec.slot + 1, unused);
+      }
+      if (slots[spec.slot].first == count) {
+        slots[spec.slot].first = (uint32_t)s;
       }
-      auto fit = records_[i].fields.find(name);
-      if (fit != records_[i].fields.end()) {
-        if (fit->second.isQuoted) {
-          dest = std::string(prec->data() + fit->second.start, fit->second.len);
-        } else {
-          dest.resize(fit->second.len / 2);
-          Hexi::hex2ascii((char *)dest.data(), dest.size(), prec->data() + fit->second.start, (size_t)fit->second.len);
+      if (spec.id == FID_UNKNOWN) {
+        names[s].len = (uint32_t)strlen(spec.name);
+        names[s].hash = AuditFieldIds::hash(spec.name, names[s].len);
+      }
+    }
+
+    // one pass over the records; within a record, specs in order, and a
+    // spec can replace the value of a later spec from an earlier record
+    size_t pending = numSlots;
+    size_t found = 0;
+    for (size_t i=0; i < arena_->records.size() && pending > 0; i++) {
+      for (size_t s=0; s < count; s++) {
+        const AuditFieldSpec &spec = specs[s];
+        AuditRecArena::ExtractSlot &state = slots[spec.slot];
+        if (state.winner <= s) {
+          continue;
+        }
+        if (!_prepareRecord(i, spec.recType)) {
+          continue;
+        }
+        const string_offsets_t *entry = (spec.id != FID_UNKNOWN)
+            ? _lookupField(i, spec.id, nullptr, 0, 0)
+            : _lookupField(i, spec.id, spec.name, names[s].len, names[s].hash);
+        if (entry == nullptr) {
+          continue;
+        }
+        const char *value = arena_->records[i].buf->data() + entry->start;
+        AuditFieldValue &slot = row[spec.slot];
+        switch (spec.mode) {
+          case AuditFieldSpec::PATH:
+            _getPath(value, entry, slot.str, "");
+            slot.status = AuditParseUtils::NUM_OK;
+            break;
+          case AuditFieldSpec::DECODED:
+            _getDecoded(value, entry, _isEncodedField(arena_->records[i].buf->getType(), spec.id, spec.name),
+                        slot.str, "");
+            slot.status = AuditParseUtils::NUM_OK;
+            break;
+          case AuditFieldSpec::INT:
+            slot.status = _getInt(value, entry, slot.num, 0);
+            if (slot.status == AuditParseUtils::NUM_NOT_FOUND) {
+              slot.status = AuditParseUtils::NUM_MALFORMED;
+            }
+            break;
+          default:
+            _getString(value, entry, slot.str, "");
+            slot.status = AuditParseUtils::NUM_OK;
+            break;
+        }
+        if (state.winner == count) {
+          found++;
+        }
+        state.winner = (uint32_t)s;
+        if (state.first == s) {
+          pending--;
         }
-        return true;
       }
     }
-    dest = defaultValue;
-    return false;
+    return numSlots - found;
   }
 
   /**
-   * First, calls getField(recType,name,..) and then will extracy key=value
-   * pairs from from the result (if found).  Sub keys names will have prefix.
+   * Parses the value of field 'name' as key=value pairs
+   * and copies them into dest.
    *
    * For example, if a message contains a field like:
    *  stuff='street=main zip=92544 city="Pico Mundo"'
-   * Then calling expandField(0,"stuff") will add the following to
-   * the available fields:
-   *   stuff_street : "main"
-   *   stuff_zip :"92544"
-   *   stuff_city : "Pico Mundo"
+   * Then calling expandField("stuff", 0, dest) will add the following to
+   * dest:
+   *   street : "main"
+   *   zip :"92544"
+   *   city : "Pico Mundo"
    *
-   * A call to getField(0,"stuff_zip",..) can then be called to get the value
-   *   "92544"
+   * The sub fields are indexed once per record and cached.  They are
+   * also available without expandField(), as getField("stuff_zip",..)
+   * returns "92544".
    * @return true if found, false otherwise.
    */
   bool expandField(const std::string &name, int recType, std::map<std::string,std::string> &dest) override {
-     std::string value;
-     if (!getField(name, value, "X", recType)) {
-       return false;
-     }
-     std::map<std::string,string_offsets_t> entries;
-     AuditRecParsers::getInstance().parseFields(records_[0].spBuf->getType(),
-                                     value.data(),
-                                     value.size(),
-                                     entries);
-    for (auto &it : entries) {
-      dest[it.first] = value.substr(it.second.start, it.second.len);
-    }
-     return true;
-   }
+    const uint32_t hash = AuditFieldIds::hash(name.data(), name.size());
+    const AuditFieldId id = AuditFieldIds::lookup(name.data(), name.size(), hash);
+    for (size_t i=0; i < arena_->records.size(); i++) {
+      if (!_prepareRecord(i, recType)) {
+        continue;
+      }
+      AuditRecNestedFields *nested = _expand(i, id, name.data(), name.size(), hash);
+      if (nested == nullptr) {
+        continue;
+      }
+      const char *data = arena_->records[i].buf->data();
+      for (size_t j=0; j < nested->fields.size(); j++) {
+        auto &it = nested->fields.at(j);
+        dest[std::string(it.key, it.keylen)] = std::string(data + it.value.start, it.value.len);
+      }
+      return true;
+    }
+    return false;
+  }
 
   /**
    * When application is finished with AuditRecGroup, it needs to call
    * release so that resources (buffers) can be recycled.
    */
   void release() override {
-    header_.serial = "";
-    for (auto &rec : records_) {
-      allocator_->recycle(rec.spBuf);
+    header_.serial = 0;
+    if (arena_ != _emptyArena()) {
+      allocator_->recycleArena(arena_);
+      arena_ = _emptyArena();
     }
-    records_.clear();
   }
 
 protected:
 
+  /*
+   * Finds field 'name' in records of recType (any if 0), parsing
+   * records on first access.  The first nth records that have the
+   * field are skipped.
+   * @return pointer to value in the record buffer, or nullptr if not found.
+   */
+  const char *_findField(const std::string &name, int recType, int nth, const string_offsets_t *&entry) {
+    const uint32_t hash = AuditFieldIds::hash(name.data(), name.size());
+    const AuditFieldId id = AuditFieldIds::lookup(name.data(), name.size(), hash);
+    for (size_t i=0; i < arena_->records.size(); i++) {
+      if (!_prepareRecord(i, recType)) {
+        continue;
+      }
+      const string_offsets_t *fit = _lookupField(i, id, name.data(), name.size(), hash);
+      if (fit != nullptr) {
+        if (nth > 0) {
+          nth--;
+          continue;
+        }
+        entry = fit;
+        return arena_->records[i].buf->data() + fit->start;
+      }
+    }
+    if (id == FID_UNKNOWN) {
+      return _findNestedField(name, recType, nth, entry);
+    }
+    return nullptr;
+  }
+
+  /*
+   * Looks for "parent_sub" as field sub within the quoted value of
+   * field parent, e.g. msg_acct for acct in msg='... acct="root" ...'
+   */
+  const char *_findNestedField(const std::string &name, int recType, int nth, const string_offsets_t *&entry) {
+    for (size_t pos = name.find('_', 1); pos != std::string::npos && pos + 1 < name.size();
+         pos = name.find('_', pos + 1)) {
+      const char *sub = name.data() + pos + 1;
+      const size_t sublen = name.size() - pos - 1;
+      const uint32_t parentHash = AuditFieldIds::hash(name.data(), pos);
+      const AuditFieldId parentId = AuditFieldIds::lookup(name.data(), pos, parentHash);
+      for (size_t i=0; i < arena_->records.size(); i++) {
+        if (!_prepareRecord(i, recType)) {
+          continue;
+        }
+        AuditRecNestedFields *nested = _expand(i, parentId, name.data(), pos, parentHash);
+        if (nested == nullptr) {
+          continue;
+        }
+        const string_offsets_t *fit = nested->fields.find(sub, sublen, AuditFieldIds::hash(sub, sublen));
+        if (fit != nullptr) {
+          if (nth > 0) {
+            nth--;
+            continue;
+          }
+          entry = fit;
+          return arena_->records[i].buf->data() + fit->start;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  /*
+   * Returns the nested fields of field 'parent' in record i, indexing
+   * them on first use.
+   * @return nullptr if record i has no such field, or its value is not quoted.
+   */
+  AuditRecNestedFields *_expand(size_t i, AuditFieldId id, const char *parent, size_t parentlen, uint32_t hash) {
+    auto &rec = arena_->records[i];
+    const string_offsets_t *fit = _lookupField(i, id, parent, parentlen, hash);
+    if (fit == nullptr || !fit->isQuoted) {
+      return nullptr;
+    }
+    for (auto &spNested : rec.nested) {
+      if (spNested->valueStart == fit->start) {
+        return spNested.get();
+      }
+    }
+
+    std::unique_ptr<AuditRecNestedFields> spNested(new AuditRecNestedFields());
+    spNested->valueStart = fit->start;
+    parsers_->parseNestedFields(rec.buf->getType(), rec.buf->data() + fit->start, fit->len, spNested->fields);
+    spNested->fields.shiftValues(fit->start);
+    rec.nested.push_back(std::move(spNested));
+    return rec.nested.back().get();
+  }
+
+  const char *_findField(AuditFieldId id, int recType, int nth, const string_offsets_t *&entry) {
+    for (size_t i=0; i < arena_->records.size(); i++) {
+      if (!_prepareRecord(i, recType)) {
+        continue;
+      }
+      const string_offsets_t *fit = _lookupField(i, id, nullptr, 0, 0);
+      if (fit != nullptr) {
+        if (nth > 0) {
+          nth--;
+          continue;
+        }
+        entry = fit;
+        return arena_->records[i].buf->data() + fit->start;
+      }
+    }
+    return nullptr;
+  }
+
+  /*
+   * Looks up field in parsed record i by id, or by name if id is
+   * FID_UNKNOWN.  A miss in a partially indexed record triggers a
+   * full parse of it.
+   */
+  const string_offsets_t *_lookupField(size_t i, AuditFieldId id, const char *name, size_t namelen, uint32_t hash) {
+    auto &fields = arena_->records[i].fields;
+    const string_offsets_t *fit = (id != FID_UNKNOWN) ? fields.find(id) : fields.find(name, namelen, hash);
+    if (fit == nullptr && fields.isPartial()) {
+      _parseRecord(i, false);
+      fit = (id != FID_UNKNOWN) ? fields.find(id) : fields.find(name, namelen, hash);
+    }
+    return fit;
+  }
+
+  /*
+   * Parses record i if needed.
+   * @return false if record should be skipped for recType.
+   */
+  bool _prepareRecord(size_t i, int recType) {
+    auto &prec = arena_->records[i].buf;
+    if (recType != 0 && prec->getType() != recType) {
+      return false;
+    }
+    if (!arena_->records[i].isProcessed) {
+      _parseRecord(i, true);
+    }
+    return true;
+  }
+
+  /*
+   * (Re)builds the field index of record i.  With useProjection, only
+   * the fields projected for its type are indexed.
+   */
+  void _parseRecord(size_t i, bool useProjection) {
+    auto &prec = arena_->records[i].buf;
+    const AuditFieldSet *projection = nullptr;
+    if (useProjection && projection_ != nullptr) {
+      projection = projection_->get(prec->getType());
+    }
+    arena_->records[i].fields.clear();
+    parsers_->parseFields(prec->getType(), prec->data(), prec->size(),
+                          arena_->records[i].fields, projection);
+    arena_->records[i].isProcessed = true;
+  }
+
+  bool _getString(const char *value, const string_offsets_t *entry, std::string &dest, const std::string &defaultValue) {
+    if (value == nullptr) {
+      dest = defaultValue;
+      return false;
+    }
+    dest.assign(value, entry->len);
+    return true;
+  }
+
+  bool _getView(const char *value, const string_offsets_t *entry, AuditFieldView &dest) {
+    if (value == nullptr) {
+      dest.data = "";
+      dest.len = 0;
+      dest.isQuoted = false;
+      dest.encoding = VALUE_PLAIN;
+      return false;
+    }
+    dest.data = value;
+    dest.len = entry->len;
+    dest.isQuoted = entry->isQuoted;
+    dest.encoding = entry->encodingOf(value);
+    return true;
+  }
+
+  /*
+   * Returns the value, hex decoded if decode is set and the tokenizer
+   * classified it as hex.  Decoded values are kept in the scratch
+   * arena until release().
+   */
+  AuditRecDecodedValue _decode(const char *value, const string_offsets_t *entry, bool decode) {
+    AuditRecDecodedValue decoded = {value, value, entry->len};
+    if (!decode || entry->encodingOf(value) != VALUE_HEX) {
+      return decoded;
+    }
+    for (auto &it : arena_->decoded) {
+      if (it.raw == value) {
+        return it;
+      }
+    }
+    const size_t len = entry->len;
+    char *dest = arena_->scratch.alloc(len / 2);
+    Hexi::hex2ascii(dest, len / 2, value, len);  // validated by the tokenizer
+    decoded.data = dest;
+    decoded.len = len / 2;
+    arena_->decoded.push_back(decoded);
+    return decoded;
+  }
+
+  /*
+   * True if field id (or name, when id is FID_UNKNOWN) is one that
+   * auditd hex-encodes, in record of type recType.
+   */
+  bool _isEncodedField(int recType, AuditFieldId id, const char *name) {
+    if (AuditFieldIds::isEncoded(id)) {
+      return true;
+    }
+    if (recType != AUDIT_EXECVE) {
+      return false;
+    }
+    return (id >= FID_A0 && id <= FID_A3) ||
+           (id == FID_UNKNOWN && name != nullptr && AuditFieldIds::isExecveArg(name, strlen(name)));
+  }
+
+  bool _isEncodedField(const char *value, AuditFieldId id, const char *name) {
+    if (value == nullptr) {
+      return false;
+    }
+    if (AuditFieldIds::isEncoded(id)) {
+      return true;
+    }
+    return _isEncodedField(_typeOf(value), id, name);
+  }
+
+  /*
+   * @return type of the record holding value, or 0.
+   */
+  int _typeOf(const char *value) {
+    for (auto &rec : arena_->records) {
+      const char *data = rec.buf->data();
+      if (value >= data && value < data + rec.buf->size()) {
+        return rec.buf->getType();
+      }
+    }
+    return 0;
+  }
+
+  bool _getDecodedView(const char *value, const string_offsets_t *entry, bool decode, AuditFieldView &dest) {
+    if (!_getView(value, entry, dest)) {
+      return false;
+    }
+    AuditRecDecodedValue decoded = _decode(value, entry, decode);
+    dest.data = decoded.data;
+    dest.len = decoded.len;
+    return true;
+  }
+
+  bool _getDecoded(const char *value, const string_offsets_t *entry, bool decode, std::string &dest, const std::string &defaultValue) {
+    if (value == nullptr) {
+      dest = defaultValue;
+      return false;
+    }
+    AuditRecDecodedValue decoded = _decode(value, entry, decode);
+    dest.assign(decoded.data, decoded.len);
+    return true;
+  }
+
+  bool _getPathView(const char *value, const string_offsets_t *entry, AuditFieldView &dest) {
+    return _getDecodedView(value, entry, true, dest);
+  }
+
+  bool _getPathInto(const char *value, const string_offsets_t *entry, char *dest, size_t destsize, size_t &destlen) {
+    if (value == nullptr) {
+      destlen = 0;
+      return false;
+    }
+    AuditRecDecodedValue decoded = _decode(value, entry, true);
+    destlen = decoded.len;
+    if (decoded.len <= destsize) {
+      memcpy(dest, decoded.data, decoded.len);
+    }
+    return true;
+  }
+
+  bool _getPath(const char *value, const string_offsets_t *entry, std::string &dest, const std::string &defaultValue) {
+    return _getDecoded(value, entry, true, dest, defaultValue);
+  }
+
+  int _getInt(const char *value, const string_offsets_t *entry, int64_t &dest, int64_t defaultValue) {
+    int status = (value == nullptr) ? (int)AuditParseUtils::NUM_NOT_FOUND :
+                 AuditParseUtils::parseInt64(value, entry->len, dest);
+    if (status != AuditParseUtils::NUM_OK) {
+      dest = defaultValue;
+    }
+    return status;
+  }
+
+  int _getUInt(const char *value, const string_offsets_t *entry, uint64_t &dest, uint64_t defaultValue) {
+    int status = (value == nullptr) ? (int)AuditParseUtils::NUM_NOT_FOUND :
+                 AuditParseUtils::parseUInt64(value, entry->len, dest);
+    if (status != AuditParseUtils::NUM_OK) {
+      dest = defaultValue;
+    }
+    return status;
+  }
+
+  int _getHex(const char *value, const string_offsets_t *entry, uint64_t &dest, uint64_t defaultValue) {
+    int status = (value == nullptr) ? (int)AuditParseUtils::NUM_NOT_FOUND :
+                 AuditParseUtils::parseHex64(value, entry->len, dest);
+    if (status != AuditParseUtils::NUM_OK) {
+      dest = defaultValue;
+    }
+    return status;
+  }
+
   AuditRecState* _getMessageType(int type, int n=0) {
-    for (int i=0; i < records_.size(); i++) {
-      if (records_[i].spBuf->getType() == type) {
+    for (size_t i=0; i < arena_->records.size(); i++) {
+      if (arena_->records[i].buf->getType() == type) {
         if (n > 0) {
           n--;
           continue;
         }
-        return &records_[i];
+        return &arena_->records[i];
       }
     }
     return nullptr;
   }
 
 
-  AuditGroupHdr header_;
+  bool _acquireArena() {
+    if (arena_ == _emptyArena()) {
+      SPAuditRecArena spArena = allocator_->allocArena();
+      if (spArena == nullptr) {
+        return false;
+      }
+      arena_ = spArena;
+    }
+    return true;
+  }
 
-  std::vector<AuditRecState> records_;
+  /*
+   * Stands in for the arena of groups without records, and of released
+   * ones.  It is never appended to.
+   */
+  static const SPAuditRecArena &_emptyArena() {
+    static const SPAuditRecArena empty = std::make_shared<AuditRecArena>();
+    return empty;
+  }
+
+  AuditGroupHdr header_;
 
   SPAuditRecAllocator allocator_;
+
+  // records, their parse state and decoded values
+  SPAuditRecArena arena_;
+
+  std::shared_ptr<const AuditRecParsers> parsers_;
+
+  std::shared_ptr<const AuditFieldProjection> projection_;
 };
 
 typedef std::shared_ptr<AuditRecGroupImpl> SPAuditGroupImpl;
@@ -198,13 +723,69 @@ typedef std::shared_ptr<AuditRecGroupImpl> SPAuditGroupImpl;
 
 class AuditCollectorImpl : public AuditCollector {
 public:
-  AuditCollectorImpl(SPAuditListener l, size_t max_pool_size) : AuditCollector(), spListener_(l),
+  AuditCollectorImpl(SPAuditListener l, size_t max_pool_size, SPAuditRecParsers parsers) : AuditCollector(), spListener_(l),
   spCurrent_(),
-  allocator_(std::make_shared<AuditRecAllocator>(max_pool_size)) {
+  allocator_(std::make_shared<AuditRecAllocator>(max_pool_size)),
+  parsers_(parsers != nullptr ? parsers : AuditRecParsersNew()), projection_() {
   }
 
   virtual ~AuditCollectorImpl() {}
 
+  bool onAuditRecord(struct audit_reply &temp) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    int preamble_size;
+    if (_startRecord(temp.msg.data, temp.len, preamble_size)) {
+      return true;
+    }
+
+    // copy record to the group arena, noting the length of preamble
+    // for when fields get parsed
+
+    if (!spCurrent_->add(temp.msg, temp.type, temp.len, preamble_size)) {
+      return true;
+    }
+    _endRecord(temp.type);
+    return false;
+  }
+
+  /**
+   * If there's a current group, compact and send it.
+   */
+  virtual void flush() override {
+    if (spCurrent_ != nullptr) {
+
+      if (spListener_ != nullptr) {
+        spListener_->onAuditRecords(spCurrent_);
+      }
+    }
+    spCurrent_ = nullptr;
+  }
+
+  /*
+   * Groups hold on to the projection they were created with, so
+   * replace rather than modify it.
+   */
+  void setProjection(int recType, const AuditFieldSet &fields) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto spNext = (projection_ == nullptr) ? std::make_shared<AuditFieldProjection>() :
+                  std::make_shared<AuditFieldProjection>(*projection_);
+    spNext->set(recType, fields);
+    projection_ = spNext;
+  }
+
+  void clearProjection(int recType) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (projection_ == nullptr) {
+      return;
+    }
+    auto spNext = std::make_shared<AuditFieldProjection>(*projection_);
+    spNext->remove(recType);
+    projection_ = spNext->empty() ? nullptr : spNext;
+  }
+
+protected:
+
   /*
    * Preamble is of format:
    * "audit(1566400376.394:262):"
@@ -212,15 +793,13 @@ public:
    * seconds and milliseconds are fixed length
    * serial not always 3 characters
    *
+   * Checks the preamble of msg and makes sure spCurrent_ is the group
+   * of its serial, sending the previous group if there was one.
+   * @return true if msg is not a valid record
    */
-  bool onAuditRecord(struct audit_reply &temp) override {
-    std::lock_guard<std::mutex> lock(mutex_);
+  bool _startRecord(const char *msg, int msglen, int &preamble_size) {
     // sanity check
 
-    char * msg = temp.msg.data  ;//spRec->data();
-    int msglen = temp.len;
-    int msgtype = temp.type;
-
     if (msglen < 23 || msg[0] != 'a' || msg[5] != '(' || msg[20] != ':') {
       return true;
     }
@@ -228,22 +807,22 @@ public:
 
     const char *pend = msg + msglen;
     const char *p = msg + 21;
-    const char *start = p;
 
-    // find trailing brace after serial
+    // parse serial up to trailing brace
 
-    while (p < pend && *p != ')') p++;
-    if (*p != ')') {
+    uint64_t serial = 0;
+    uint32_t digit;
+    while (p < pend && (digit = (uint32_t)(uint8_t)*p - '0') <= 9) {
+      serial = serial * 10 + digit;
+      p++;
+    }
+    if (p == pend || *p != ')' || p == msg + 21) {
       return true;
     }
 
-    // extract serial
-
-    std::string serial = std::string(start, p - start);
-
     // if serial matches that of current group, no need to parse timestamps
 
-    if (spCurrent_ == nullptr || serial != spCurrent_->getSerial()) {
+    if (spCurrent_ == nullptr || serial != spCurrent_->getHeader().serial) {
 
       if (spCurrent_ != nullptr) {
         // we have an in-progress group, close and send it.
@@ -251,60 +830,48 @@ public:
       }
 
       // parse timestamp
-      std::string secondstr = std::string(msg + 6, msg + 16);
-      std::string millistr = std::string(msg + 17, msg + 20);
-      auto ts = atol(secondstr.c_str());
-      auto tms = atoi(millistr.c_str());
 
-      spCurrent_ = std::make_shared<AuditRecGroupImpl>(serial, (int64_t)ts, (uint32_t)tms, allocator_);
+      uint64_t ts, tms;
+      if (AuditParseUtils::parseFixedDigits(msg + 6, 10, ts) != AuditParseUtils::NUM_OK ||
+          msg[16] != '.' ||
+          AuditParseUtils::parseFixedDigits(msg + 17, 3, tms) != AuditParseUtils::NUM_OK) {
+        return true;
+      }
+
+      spCurrent_ = std::make_shared<AuditRecGroupImpl>(serial, ts, (uint32_t)tms, allocator_, parsers_, projection_);
     }
 
-    size_t preamble_size = (p - msg) + 3;  // "): "
+    preamble_size = (int)(p - msg) + 3;  // "): "
 
     // special case when no space after colon
 
     if (preamble_size > msglen) { preamble_size = msglen; }
 
-    // note the length of preamble for when fields get parsed
-    auto spRec = allocator_->alloc(temp.msg, msgtype, msglen, preamble_size);
-
-    //spRec->setOffset(preamble_size);
-
-    // add record to current group
-
-    spCurrent_->add(spRec);
-
-    if (msgtype == AUDIT_RECORD_TYPE_END_GROUP) {
-      flush();
-    }
-
     return false;
   }
 
-  /**
-   * If there's a current group, compact and send it.
-   */
-  virtual void flush() override {
-    if (spCurrent_ != nullptr) {
-
-      if (spListener_ != nullptr) {
-        spListener_->onAuditRecords(spCurrent_);
-      }
+  void _endRecord(int msgtype) {
+    if (msgtype == AUDIT_RECORD_TYPE_END_GROUP) {
+      flush();
     }
-    spCurrent_ = nullptr;
   }
 
-
-protected:
-
   SPAuditListener spListener_;
   SPAuditGroupImpl spCurrent_;
   std::shared_ptr<AuditRecAllocator> allocator_;
+  std::shared_ptr<const AuditRecParsers> parsers_;
+  std::shared_ptr<const AuditFieldProjection> projection_;
   std::mutex mutex_;
 };
 
 namespace {
-SPAuditCollector AuditCollectorNew(SPAuditListener listener, size_t max_pool_size = 500) {
-  return std::make_shared<AuditCollectorImpl>(listener, max_pool_size);
+/**
+ * @param parsers Record parsers for this collector, e.g. from
+ *                AuditRecParsersNew().  If null, only the default
+ *                parser is used.
+ */
+SPAuditCollector AuditCollectorNew(SPAuditListener listener, size_t max_pool_size = 500,
+                                   SPAuditRecParsers parsers = nullptr) {
+  return std::make_shared<AuditCollectorImpl>(listener, max_pool_size, parsers);
 }
 }
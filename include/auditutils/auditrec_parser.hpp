@@ -1,9 +1,11 @@
 #pragma once
 
 #include <map>
+#include "auditutils.hpp"
+#include "auditfield_ids.hpp"
 
 struct AuditGroupHdr {
-  std::string serial;
+  uint64_t serial;
   uint64_t tsec;
   uint32_t tms;
 };
@@ -22,6 +24,9 @@ struct AuditGroupHdr {
  * The audit_reply has a fixed msg.data[] size of 8192 chars.
  * This allows application to transfer data to smaller record buffers
  * for processing.
+ * The library's own buffers are AuditRecordBuf; other implementations
+ * can be handed to AuditRecAllocator::duplicate() and
+ * AuditRecGroupImpl::add(), which copy them.
  */
 struct AuditRecBuf {
 
@@ -55,10 +60,54 @@ struct AuditRecBuf {
 
 typedef std::shared_ptr<AuditRecBuf> SPAuditRecBuf;
 
+/*
+ * Field value in the record buffer, without quotes.  Not null
+ * terminated.  Valid until AuditRecGroup::release().
+ */
+struct AuditFieldView {
+  const char *data;
+  size_t      len;
+  bool        isQuoted;
+  uint8_t     encoding;  // AuditValueEncoding of the text in the record
+};
+
+/*
+ * One field to fetch with AuditRecGroup::extractFields().
+ */
+struct AuditFieldSpec {
+  enum Mode {
+    RAW = 0,   // value text as in getField()
+    PATH,      // hex decoded as in getPathField()
+    INT,       // signed decimal as in getFieldInt()
+    DECODED    // as in getDecodedField()
+  };
+
+  int          recType;   // 0 for any record in group
+  AuditFieldId id;        // FID_UNKNOWN to look up by name
+  const char * name;      // used when id is FID_UNKNOWN
+  uint16_t     slot;      // index into the row passed to extractFields()
+  uint8_t      mode;
+};
+
+/*
+ * Destination slot of an AuditFieldSpec.  str is set for RAW, PATH and
+ * DECODED, num for INT.
+ * status is AuditParseUtils::NUM_NOT_FOUND if the field was missing,
+ * NUM_OK if it was found, or the number parse error for INT.
+ */
+struct AuditFieldValue {
+  std::string str;
+  int64_t     num;
+  int         status;
+};
+
 struct AuditRecGroup {
 
+  // decimal text of getSerialNumber(), built on each call
   virtual std::string     getSerial() = 0;
 
+  virtual uint64_t        getSerialNumber() = 0;
+
   virtual uint64_t        getTimeSeconds() = 0;
 
   virtual uint32_t        getTimeMs() = 0;
@@ -67,7 +116,8 @@ struct AuditRecGroup {
 
   virtual size_t          getNumMessages() = 0;
 
-  // get nth message
+  // get nth message.  Holding it past release() keeps the group's
+  // record storage from being reused.
   virtual SPAuditRecBuf   getMessage(int i) = 0;
 
   // get by type. e.g. AUDIT_EXECVE
@@ -84,18 +134,110 @@ struct AuditRecGroup {
    * @param recType If recType != 0, will only search records with that type for the
    * field. Specifying recType is more efficient, as the lazy parsing of
    * records need not be done for recTypes not specified.
-   * @param nth If > 0, will return the nth instance of the field 'name'.
+   * @param nth If > 0, skips the first nth records that have the field,
+   * so 1 returns the value from the second such record.
    *
    * If field not found, dest will be set to defaultValue.
    * @return true if found, false otherwise.
    */
-  virtual bool getField(const std::string &name, std::string &dest, std::string defaultValue, int recType=0, int nth=0) = 0;
+  virtual bool getField(const std::string &name, std::string &dest, const std::string &defaultValue, int recType=0, int nth=0) = 0;
 
   /**
    * similar to above getField(), but will decode hex-encoded field values
    * which is how auditd handles paths containing spaces.
+   * Unquoted values that are not valid hex (e.g. "(null)") are returned as-is.
+   */
+  virtual bool getPathField(const std::string &name, std::string &dest, const std::string &defaultValue, int recType=0, int nth=0) = 0;
+
+  /**
+   * Typed variants of getField() for numeric fields such as pid, uid,
+   * exit and ses.  The value is parsed in place, nothing is allocated.
+   * getFieldHex() is for hex fields such as arch and a0..a3.
+   *
+   * If the field is not found or its value is not a valid number,
+   * dest will be set to defaultValue.
+   * @return AuditParseUtils::NUM_OK, NUM_NOT_FOUND, NUM_MALFORMED or NUM_OVERFLOW
+   */
+  virtual int getFieldInt(const std::string &name, int64_t &dest, int64_t defaultValue, int recType=0, int nth=0) = 0;
+
+  virtual int getFieldUInt(const std::string &name, uint64_t &dest, uint64_t defaultValue, int recType=0, int nth=0) = 0;
+
+  virtual int getFieldHex(const std::string &name, uint64_t &dest, uint64_t defaultValue, int recType=0, int nth=0) = 0;
+
+  /**
+   * Same as the name based variants above, for well-known fields.
+   * Fields are matched by integer ID, no string compares.
+   * e.g. getField(FID_PID, pidstr, "")
+   */
+  virtual bool getField(AuditFieldId id, std::string &dest, const std::string &defaultValue, int recType=0, int nth=0) = 0;
+
+  virtual bool getPathField(AuditFieldId id, std::string &dest, const std::string &defaultValue, int recType=0, int nth=0) = 0;
+
+  virtual int getFieldInt(AuditFieldId id, int64_t &dest, int64_t defaultValue, int recType=0, int nth=0) = 0;
+
+  virtual int getFieldUInt(AuditFieldId id, uint64_t &dest, uint64_t defaultValue, int recType=0, int nth=0) = 0;
+
+  virtual int getFieldHex(AuditFieldId id, uint64_t &dest, uint64_t defaultValue, int recType=0, int nth=0) = 0;
+
+  /**
+   * Like getField(), but returns a view of the value in the record
+   * buffer instead of copying it.
+   * If field not found, dest is set to an empty view.
+   * @return true if found, false otherwise.
+   */
+  virtual bool getFieldView(const std::string &name, AuditFieldView &dest, int recType=0, int nth=0) = 0;
+
+  virtual bool getFieldView(AuditFieldId id, AuditFieldView &dest, int recType=0, int nth=0) = 0;
+
+  /**
+   * Like getPathField(), but returns a view of the decoded value.
+   * Hex values are decoded once per group, into scratch memory that
+   * is valid until release().
+   * @return true if found, false otherwise.
    */
-  virtual bool getPathField(const std::string &name, std::string &dest, std::string defaultValue, int recType=0, int nth=0) = 0;
+  virtual bool getPathFieldView(const std::string &name, AuditFieldView &dest, int recType=0, int nth=0) = 0;
+
+  virtual bool getPathFieldView(AuditFieldId id, AuditFieldView &dest, int recType=0, int nth=0) = 0;
+
+  /**
+   * Like getPathField(), but decodes into caller storage.
+   * destlen is set to the length of the value.  If destlen > destsize,
+   * dest was too small and its contents are undefined.  A buffer as
+   * large as the getFieldView() length is always enough.
+   * @return true if found, false otherwise.
+   */
+  virtual bool getPathField(const std::string &name, char *dest, size_t destsize, size_t &destlen, int recType=0, int nth=0) = 0;
+
+  virtual bool getPathField(AuditFieldId id, char *dest, size_t destsize, size_t &destlen, int recType=0, int nth=0) = 0;
+
+  /**
+   * Returns the value of any field decoded the way auditd encoded it.
+   * Values of fields that auditd hex-encodes (comm, exe, name, cwd,
+   * proctitle, key, execve args, ...) are decoded when unquoted.
+   * Everything else, e.g. pid=1234 or a1=7ffd0a10 in SYSCALL records,
+   * is returned as-is, even if it looks like hex.
+   * The view variant returns decoded values from per-group scratch
+   * memory, valid until release().
+   * @return true if found, false otherwise.
+   */
+  virtual bool getDecodedField(const std::string &name, std::string &dest, const std::string &defaultValue, int recType=0, int nth=0) = 0;
+
+  virtual bool getDecodedField(AuditFieldId id, std::string &dest, const std::string &defaultValue, int recType=0, int nth=0) = 0;
+
+  virtual bool getDecodedFieldView(const std::string &name, AuditFieldView &dest, int recType=0, int nth=0) = 0;
+
+  virtual bool getDecodedFieldView(AuditFieldId id, AuditFieldView &dest, int recType=0, int nth=0) = 0;
+
+  /**
+   * Fetches all fields described by specs, filling row[spec.slot] for
+   * each from the first record of the group that has the field.
+   * Specs are tried in order, and once a slot is filled, later specs
+   * for the same slot are skipped, so a slot can list fallbacks, e.g.
+   * cwd from 1307 else from 1300, whatever the record order.
+   * Slots of missing fields have status NUM_NOT_FOUND.
+   * @return number of slots not found
+   */
+  virtual size_t extractFields(const AuditFieldSpec *specs, size_t count, AuditFieldValue *row) = 0;
 
  /**
   * First, calls getField(recType,name,..) and then will extracy key=value
@@ -109,6 +251,9 @@ struct AuditRecGroup {
   *   zip :"92544"
   *   city : "Pico Mundo"
   *
+  * Sub fields are indexed in place on first use and are also returned
+  * by getField() as "parent_sub", e.g. getField("stuff_zip",..)
+  *
   * @return true if found, false otherwise.
   */
   virtual bool expandField(const std::string &name, int recType, std::map<std::string,std::string> &dest) = 0;
@@ -116,6 +261,7 @@ struct AuditRecGroup {
   /*
    * Called by application when done accessing all records and fields.
    * This will cause the record buffers to be freed or put back in pool.
+   * Groups destroyed without release() are released then.
    */
   virtual void release() = 0;
 };
@@ -134,26 +280,25 @@ typedef std::shared_ptr<AuditListener> SPAuditListener;
 
 /*
  * The application is responsible for reading the auditd socket,
- * filling an AuditRecBuf and passing it to the
- * AuditCollector.onAuditRecord().  The collector assumes ownership
- * of the AuditRecBuf.
+ * filling an audit_reply and passing it to the
+ * AuditCollector.onAuditRecord(), which copies the message.
  * The AuditCollector will group together messages with the same serial
  * and pass to the AuditListener.onAuditRecords().
  * Usage:
  *
  * auto spCollector = AuditCollectorNew(myListener);
- * auto spReply = spCollector->allocReply();
+ * struct audit_reply reply;
  *
- * // read from socket and fill spReply->data()
+ * // read from socket and fill reply, e.g. audit_get_reply()
  *
- * spCollector->onAuditRecord(spReply);
+ * spCollector->onAuditRecord(reply);
  *
  */
 struct AuditCollector {
 
   /*
    * Pass on auditd reply to collector for grouping and processing
-   * so that listener may receive it.
+   * so that listener may receive it.  The message is copied.
    */
   virtual bool onAuditRecord(struct audit_reply &temp) = 0;
 
@@ -162,6 +307,19 @@ struct AuditCollector {
    * to pass on any cached records being grouped to the listener.
    */
   virtual void flush() = 0;
+
+  /**
+   * Declares the fields the application reads from records of recType.
+   * Those records are then only indexed for these fields.  Other fields
+   * can still be read with getField(), at the cost of a full parse of
+   * that record.  Applies to groups started after the call.
+   */
+  virtual void setProjection(int recType, const AuditFieldSet &fields) = 0;
+
+  /**
+   * Go back to indexing all fields of recType.
+   */
+  virtual void clearProjection(int recType) = 0;
 };
 
 typedef std::shared_ptr<AuditCollector> SPAuditCollector;
@@ -169,5 +327,6 @@ typedef std::shared_ptr<AuditCollector> SPAuditCollector;
 // SPAuditCollector AuditCollectorNew(SPAuditListener listener, ..);
 #include "hexi.hpp"
 #include "auditrec_parser_impl.hpp"
+#include "auditrec_schema_impl.hpp"
 #include "auditrec_buffers_impl.hpp"
 #include "auditrec_collector_impl.hpp"
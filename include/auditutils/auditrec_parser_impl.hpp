@@ -1,8 +1,18 @@
 #pragma once
 
 #include <stdint.h>
+#include <algorithm>
+#include <string.h>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <initializer_list>
+#include <vector>
+#include <atomic>
+#include "auditrec_scan_impl.hpp"
+#include "auditfield_ids.hpp"
+#include "hexi.hpp"
 
 /*
  * Since we don't know which fields will be requested by application,
@@ -11,30 +21,295 @@
  * requested.
  */
 struct string_offsets_t {
+  // encoding of a value whose classification was left to encodingOf()
+  enum : uint8_t { ENCODING_DEFERRED = 0xff };
+
   uint32_t start;
   uint32_t len;
   bool     isQuoted;
+  uint8_t  encoding;  // AuditValueEncoding, or ENCODING_DEFERRED
+
+  /*
+   * @param value the value text, i.e. start resolved against its body
+   * @return encoding, classifying the value now if it was deferred
+   */
+  uint8_t encodingOf(const char *value) const {
+    if (encoding != ENCODING_DEFERRED) {
+      return encoding;
+    }
+    return classify(value, len, isQuoted, !isQuoted && Hexi::isHex(value, len));
+  }
+
+  /*
+   * @param allHex true if every char of the unquoted value is a hex digit
+   */
+  static uint8_t classify(const char *value, size_t len, bool isQuoted, bool allHex) {
+    if (isQuoted) {
+      return VALUE_QUOTED;
+    }
+    if (allHex) {
+      return (len > 0 && len % 2 == 0) ? VALUE_HEX : VALUE_PLAIN;
+    }
+    if ((len == 6 && (memcmp(value, "(null)", 6) == 0 || memcmp(value, "(none)", 6) == 0)) ||
+        (len == 1 && value[0] == '?')) {
+      return VALUE_LITERAL;
+    }
+    return VALUE_PLAIN;
+  }
+};
+
+/*
+ * Per-record field index.  Keys are not copied: each entry points at
+ * the key text inside the record buffer (or a static string for
+ * synthetic keys), so the index is only valid while that buffer is.
+ * The first INLINE_CAPACITY fields live inline; larger records spill
+ * the rest to a vector.  Adding an existing key replaces its value,
+ * like std::map::operator[].  Well-known keys are tagged with their
+ * AuditFieldId and matched by ID.
+ */
+struct AuditRecFieldIndex {
+  enum : size_t { INLINE_CAPACITY = 32 };
+
+  struct Entry {
+    const char       *key;
+    uint16_t          keylen;
+    uint16_t          id;
+    uint32_t          hash;
+    string_offsets_t  value;
+  };
+
+  AuditRecFieldIndex() : count_(0), spill_(), spillSlots_(), isPartial_(false), numUnknown_(0) {
+    seenIds_[0] = seenIds_[1] = 0;
+  }
+
+  void clear() {
+    count_ = 0;
+    if (!spill_.empty()) {
+      spill_.clear();
+      std::fill(spillSlots_.begin(), spillSlots_.end(), 0);
+    }
+    isPartial_ = false;
+    numUnknown_ = 0;
+    seenIds_[0] = seenIds_[1] = 0;
+  }
+
+  /*
+   * True when only projected fields were indexed, so a miss
+   * does not mean the field is absent from the record.
+   */
+  bool isPartial() const {
+    return isPartial_;
+  }
+
+  void setPartial(bool partial) {
+    isPartial_ = partial;
+  }
+
+  size_t size() const {
+    return count_ + spill_.size();
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  const Entry &at(size_t i) const {
+    return (i < INLINE_CAPACITY) ? entries_[i] : spill_[i - INLINE_CAPACITY];
+  }
+
+  void add(const char *key, size_t keylen, const string_offsets_t &value) {
+    uint32_t h = hash(key, keylen);
+    add(key, keylen, h, AuditFieldIds::lookup(key, keylen, h), value);
+  }
+
+  /*
+   * For callers that already have the key hash and ID.
+   */
+  void add(const char *key, size_t keylen, uint32_t h, AuditFieldId id, const string_offsets_t &value) {
+    Entry *existing = (id != FID_UNKNOWN) ? _find(id, h) : _find(key, keylen, h);
+    if (existing != nullptr) {
+      existing->value = value;
+      return;
+    }
+    if (id != FID_UNKNOWN) {
+      seenIds_[id >> 6] |= 1ULL << (id & 63);
+    } else {
+      numUnknown_++;
+    }
+    Entry entry = {key, (uint16_t)keylen, (uint16_t)id, h, value};
+    if (count_ < INLINE_CAPACITY) {
+      entries_[count_++] = entry;
+    } else {
+      _addSpill(entry);
+    }
+  }
+
+  /*
+   * Key must outlive the index, so only for string literals.
+   */
+  void add(const char *key, const string_offsets_t &value) {
+    add(key, strlen(key), value);
+  }
+
+  /*
+   * @return value offsets, or nullptr if key not present.
+   */
+  const string_offsets_t *find(const char *key, size_t keylen, uint32_t h) const {
+    AuditFieldId id = AuditFieldIds::lookup(key, keylen, h);
+    auto self = const_cast<AuditRecFieldIndex *>(this);
+    const Entry *entry = (id != FID_UNKNOWN) ? self->_find(id, h) : self->_find(key, keylen, h);
+    return (entry == nullptr) ? nullptr : &entry->value;
+  }
+
+  const string_offsets_t *find(const std::string &key) const {
+    return find(key.data(), key.size(), hash(key.data(), key.size()));
+  }
+
+  const string_offsets_t *find(AuditFieldId id) const {
+    const Entry *entry = const_cast<AuditRecFieldIndex *>(this)->_find(id, 0);
+    return (entry == nullptr) ? nullptr : &entry->value;
+  }
+
+  static uint32_t hash(const char *key, size_t keylen) {
+    return AuditFieldIds::hash(key, keylen);
+  }
+
+  /*
+   * Adds delta to all value offsets, e.g. to make offsets into a
+   * field value relative to the record body.
+   */
+  void shiftValues(uint32_t delta) {
+    for (size_t i = 0; i < count_; i++) {
+      entries_[i].value.start += delta;
+    }
+    for (auto &entry : spill_) {
+      entry.value.start += delta;
+    }
+  }
+
+protected:
+  /*
+   * h is the key hash, or 0 if the caller does not have it.
+   */
+  Entry *_find(AuditFieldId id, uint32_t h) {
+    if ((seenIds_[id >> 6] & (1ULL << (id & 63))) == 0) {
+      return nullptr;
+    }
+    for (size_t i = 0; i < count_; i++) {
+      if (entries_[i].id == id) {
+        return &entries_[i];
+      }
+    }
+    if (spill_.empty()) {
+      return nullptr;
+    }
+    if (h == 0) {
+      const char *name = AuditFieldIds::name(id);
+      h = hash(name, strlen(name));
+    }
+    return _findSpill(h, [id](const Entry &entry) {
+      return entry.id == id;
+    });
+  }
+
+  Entry *_find(const char *key, size_t keylen, uint32_t h) {
+    if (numUnknown_ == 0) {
+      return nullptr;
+    }
+    for (size_t i = 0; i < count_; i++) {
+      Entry &entry = entries_[i];
+      if (entry.hash == h && entry.keylen == keylen && memcmp(entry.key, key, keylen) == 0) {
+        return &entry;
+      }
+    }
+    if (spill_.empty()) {
+      return nullptr;
+    }
+    return _findSpill(h, [key, keylen](const Entry &entry) {
+      return entry.keylen == keylen && memcmp(entry.key, key, keylen) == 0;
+    });
+  }
+
+  /*
+   * Spilled entries are found through an open addressed table of
+   * spill_ positions (+1, 0 is empty), kept at most half full, so
+   * records with hundreds of fields (e.g. long EXECVE argument lists)
+   * index in linear time.
+   */
+  template <typename Match>
+  Entry *_findSpill(uint32_t h, Match match) {
+    size_t mask = spillSlots_.size() - 1;
+    for (size_t i = _slot(h, mask); spillSlots_[i] != 0; i = (i + 1) & mask) {
+      Entry &entry = spill_[spillSlots_[i] - 1];
+      if (entry.hash == h && match(entry)) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  void _addSpill(const Entry &entry) {
+    spill_.push_back(entry);
+    if (spill_.size() * 2 > spillSlots_.size()) {
+      spillSlots_.assign(std::max<size_t>(64, spillSlots_.size() * 2), 0);
+      for (size_t i = 0; i < spill_.size(); i++) {
+        _insertSlot(spill_[i].hash, (uint32_t)i + 1);
+      }
+    } else {
+      _insertSlot(entry.hash, (uint32_t)spill_.size());
+    }
+  }
+
+  void _insertSlot(uint32_t h, uint32_t pos) {
+    size_t mask = spillSlots_.size() - 1;
+    size_t i = _slot(h, mask);
+    while (spillSlots_[i] != 0) {
+      i = (i + 1) & mask;
+    }
+    spillSlots_[i] = pos;
+  }
+
+  static size_t _slot(uint32_t h, size_t mask) {
+    return (h ^ (h >> 15)) & mask;
+  }
+
+  size_t             count_;
+  Entry              entries_[INLINE_CAPACITY];
+  std::vector<Entry> spill_;
+  std::vector<uint32_t> spillSlots_;
+  bool               isPartial_;
+  // which known IDs are present, so misses and duplicate checks are O(1)
+  uint64_t           seenIds_[2];
+  size_t             numUnknown_;
 };
 
 struct AuditRecFieldsParser {
   virtual bool handlesType(int recType) = 0;
   /**
-   * @param prefix If not empty, will be prefixed to all key names added to dest.
+   * Keys added to dest must point into body or be string literals.
    */
   virtual bool parseFields(int recType, const char *body, int bodylen,
-                 std::map<std::string, string_offsets_t> &dest) = 0;
+                 AuditRecFieldIndex &dest) = 0;
+  /**
+   * @return false if parseFields() only fits whole records, so quoted
+   * values expanded by AuditRecGroup::expandField() go through the
+   * tokenizer instead.
+   */
+  virtual bool parsesNested() {
+    return true;
+  }
 };
 
 struct DefaultAuditRecFieldParser  {
 
   /**
    * Parses the post-preamble body of Audit record message
-   * and populates 'dest' parameter which is map of fieldname => offset,len of value.
+   * and populates 'dest' parameter which is index of fieldname => offset,len of value.
    *
    * NOTE: Does not support SELinux format
    * @param body string starting with first "fieldname="
    * @param bodylen number of bytes in body
-   * @param dest map to populate with field details
+   * @param dest index to populate with field details
    *
    * audit message: "audit(1566400374.494:256): arch=c000003e syscall=42 succ..."
    * preamble: "audit(1566400374.494:256): "
@@ -44,7 +319,20 @@ struct DefaultAuditRecFieldParser  {
    */
 
   static bool parseFields(const char *body, int bodylen,
-                          std::map<std::string, string_offsets_t> &dest) {
+                          AuditRecFieldIndex &dest) {
+    return tokenize(body, bodylen, [&dest](const char *key, size_t keylen, const string_offsets_t &entry) {
+      dest.add(key, keylen, entry);
+      return true;
+    });
+  }
+
+  /**
+   * Calls onField(key, keylen, entry) for each key=value pair in body,
+   * in order.  onField returns false to stop tokenizing.
+   * @return true on parse error, false on success
+   */
+  template <typename FieldFn>
+  static bool tokenize(const char *body, int bodylen, FieldFn onField) {
     const char *start = body;
     const char *pend = body + bodylen;
 
@@ -75,15 +363,15 @@ struct DefaultAuditRecFieldParser  {
         p++;
       }
 
-      // add entry to dest
-
-      auto key = std::string(start, (keyEnd - start));
-
       string_offsets_t entry;
       entry.start = (uint32_t)(valueStart - body);
       entry.len = (uint32_t)(p - valueStart );
       entry.isQuoted = isQuoted;
-      dest[key] = entry;
+      entry.encoding = string_offsets_t::classify(valueStart, entry.len, isQuoted,
+                                                  !isQuoted && Hexi::isHex(valueStart, entry.len));
+      if (!onField(start, (size_t)(keyEnd - start), entry)) {
+        break;
+      }
 
       // advance
 
@@ -93,99 +381,262 @@ struct DefaultAuditRecFieldParser  {
   }
 };
 
+/*
+ * Produces exactly the same fields as DefaultAuditRecFieldParser, but
+ * finds '=', space and quote delimiters through AuditRecScanner
+ * bitmasks instead of comparing one char at a time.
+ */
+struct VectorAuditRecFieldParser {
 
-struct AuditRecParsers {
-  AuditRecParsers() : mutex_(), addedParsers_() {  }
-
-  bool parseFields(int recType, const char *body, int bodylen,
-                   std::map<std::string, string_offsets_t> &dest) {
-    std::lock_guard<std::mutex> lock(mutex_);
+  /**
+   * Calls onField(key, keylen, entry) for each key=value pair in body,
+   * in order.  onField returns false to stop tokenizing.
+   * @return true on parse error, false on success
+   */
+  template <typename FieldFn>
+  static bool tokenize(const char *body, int bodylen, FieldFn onField) {
+    const size_t len = (size_t)bodylen;
+    AuditRecScanner scanner(body, len);
+    size_t start = 0;
+
+    while (start < len) {
+      size_t p = scanner.find(AuditRecScanner::CLASS_EQUALS, start);
+      if (p == len) {
+        break;
+      }
+      size_t keyEnd = p;
+      p++;
+      if (p == len) {
+        return true;
+      }
+      size_t valueStart = p;
+      bool isQuoted = false;
+      int endClass = AuditRecScanner::CLASS_SPACE;
+      if (body[p] == '"' || body[p] == '\'') {
+        isQuoted = true;
+        endClass = (body[p] == '"') ? AuditRecScanner::CLASS_DQUOTE : AuditRecScanner::CLASS_SQUOTE;
+        p++;
+        valueStart = p;
+      }
+      // find end of value, checking for hex on the way
+      bool allHex = false;
+      if (isQuoted) {
+        p = scanner.find(endClass, p);
+      } else {
+        p = scanner.find(endClass, p, allHex);
+      }
 
-    if (!addedParsers_.empty()) {
-      for (auto spParser : addedParsers_) {
-        if (spParser->handlesType(recType)) {
-          return spParser->parseFields(recType, body, bodylen, dest);
-        }
+      string_offsets_t entry;
+      entry.start = (uint32_t)valueStart;
+      entry.len = (uint32_t)(p - valueStart);
+      entry.isQuoted = isQuoted;
+      entry.encoding = string_offsets_t::classify(body + valueStart, entry.len, isQuoted, allHex);
+      if (!onField(body + start, keyEnd - start, entry)) {
+        break;
       }
+
+      // advance
+
+      start = p + (isQuoted ? 2 : 1);
     }
-    return DefaultAuditRecFieldParser::parseFields(body, bodylen, dest);
+    return false;
   }
 
-  void addFieldsParser(std::shared_ptr<AuditRecFieldsParser> spParser) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    addedParsers_.insert(spParser);
+  static bool parseFields(const char *body, int bodylen,
+                          AuditRecFieldIndex &dest) {
+    return tokenize(body, bodylen, [&dest](const char *key, size_t keylen, const string_offsets_t &entry) {
+      dest.add(key, keylen, entry);
+      return true;
+    });
+  }
+};
+
+/*
+ * Tokenizer used by AuditRecParsers and the field parsers, chosen
+ * when they are constructed.  Vectorized by default;
+ * AuditRecTokenizer(false) selects the char-at-a-time
+ * DefaultAuditRecFieldParser.  Both give identical output.
+ */
+struct AuditRecTokenizer {
+
+  explicit AuditRecTokenizer(bool vectorized = true) : vectorized_(vectorized) {}
+
+  bool isVectorized() const {
+    return vectorized_;
   }
-  void removeFieldsParser(std::shared_ptr<AuditRecFieldsParser> spParser) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    addedParsers_.erase(spParser);
+
+  template <typename FieldFn>
+  bool tokenize(const char *body, int bodylen, FieldFn onField) const {
+    if (vectorized_) {
+      return VectorAuditRecFieldParser::tokenize(body, bodylen, onField);
+    }
+    return DefaultAuditRecFieldParser::tokenize(body, bodylen, onField);
   }
 
-  static AuditRecParsers& getInstance() {
-    static AuditRecParsers _inst;
-    return _inst;
+  bool parseFields(const char *body, int bodylen, AuditRecFieldIndex &dest) const {
+    if (vectorized_) {
+      return VectorAuditRecFieldParser::parseFields(body, bodylen, dest);
+    }
+    return DefaultAuditRecFieldParser::parseFields(body, bodylen, dest);
   }
+
 protected:
-    std::mutex mutex_;
-    std::set<std::shared_ptr<AuditRecFieldsParser> > addedParsers_;
+  bool vectorized_;
 };
 
-struct SELinuxFieldsParser : public AuditRecFieldsParser {
-  virtual ~SELinuxFieldsParser() {}
-  bool handlesType(int recType) override {
-    return (recType == 1107 || (recType >= 1400 || recType <= 1450));
-  }
-  bool parseFields(int recType, const char *body, int bodylen, std::map<std::string, string_offsets_t> &dest) override {
-    const char *start = body;
-    const char *pend = body + bodylen;
-    int i=0;
+/*
+ * Set of record parsers used by a collector and its groups.  Each
+ * collector has its own, so registering a parser for one pipeline does
+ * not affect others.
+ *
+ * The parsers are fixed at construction and resolved per record type
+ * into a table, the first listed parser that handles a type winning.
+ * The parse path reads the table, so it takes no lock and does not
+ * call handlesType(), and a set can be shared by collectors on any
+ * number of threads.
+ */
+struct AuditRecParsers {
+  enum : int { MAX_TABLE_TYPE = 3000 };
 
-    while (start < pend) {
-      const char *p = start ;
-      while (p != pend && *p != '=') {
-        p++;
-      }
-      if (p == pend) {
-        break;
-      }
-      const char *keyEnd = p;
-      p++;
-      if (p == pend) {
-        return true;
+  struct DispatchTable {
+    AuditRecFieldsParser *byType[MAX_TABLE_TYPE];
+    // in lookup order, for types beyond the table
+    std::vector<AuditRecFieldsParser *> parsers;
+  };
+
+  AuditRecParsers() : tokenizer_(), addedParsers_(), table_() {  }
+
+  /**
+   * @param tokenizer Used for types no added parser handles.
+   */
+  explicit AuditRecParsers(std::initializer_list<std::shared_ptr<AuditRecFieldsParser> > parsers,
+                           AuditRecTokenizer tokenizer = AuditRecTokenizer())
+      : tokenizer_(tokenizer), addedParsers_(), table_() {
+    for (auto &spParser : parsers) {
+      if (std::find(addedParsers_.begin(), addedParsers_.end(), spParser) == addedParsers_.end()) {
+        addedParsers_.push_back(spParser);
       }
-      const char *valueStart = p;
-      bool isQuoted = false;
-      char endChar = ' ';
-      if (*p == '"' || *p == '\'') {
-        isQuoted = true;
-        endChar = *p;
-        p++;
-        valueStart = p;
+    }
+    _build();
+  }
+
+  /**
+   * @param projection If not null, only these fields are indexed and
+   *                   dest is marked partial.  Types handled by an added
+   *                   parser are always indexed in full.
+   */
+  bool parseFields(int recType, const char *body, int bodylen,
+                   AuditRecFieldIndex &dest, const AuditFieldSet *projection = nullptr) const {
+    AuditRecFieldsParser *parser = _parserFor(recType);
+    if (parser != nullptr) {
+      return parser->parseFields(recType, body, bodylen, dest);
+    }
+    if (projection != nullptr) {
+      return parseProjected(body, bodylen, *projection, dest);
+    }
+    return tokenizer_.parseFields(body, bodylen, dest);
+  }
+
+  /*
+   * Indexes a quoted value of a record of recType, e.g. msg='...',
+   * with the parser of recType if it parses nested values.
+   */
+  bool parseNestedFields(int recType, const char *body, int bodylen, AuditRecFieldIndex &dest) const {
+    AuditRecFieldsParser *parser = _parserFor(recType);
+    if (parser != nullptr && parser->parsesNested()) {
+      return parser->parseFields(recType, body, bodylen, dest);
+    }
+    return tokenizer_.parseFields(body, bodylen, dest);
+  }
+
+  /*
+   * Indexes only the fields in projection.  The whole body is still
+   * scanned, so a projected key that repeats keeps its last value,
+   * the same as a full parse.
+   */
+  bool parseProjected(const char *body, int bodylen, const AuditFieldSet &projection,
+                      AuditRecFieldIndex &dest) const {
+    dest.setPartial(true);
+    if (projection.size() == 0) {
+      return false;
+    }
+    return tokenizer_.tokenize(body, bodylen,
+        [&projection, &dest](const char *key, size_t keylen, const string_offsets_t &entry) {
+      uint32_t h = AuditRecFieldIndex::hash(key, keylen);
+      AuditFieldId id = AuditFieldIds::lookup(key, keylen, h);
+      if (projection.contains(id)) {
+        dest.add(key, keylen, h, id, entry);
       }
-      // find end of value
-      while (p != pend && (*p != endChar)) {
-        p++;
+      return true;
+    });
+  }
+
+  const AuditRecTokenizer &getTokenizer() const {
+    return tokenizer_;
+  }
+
+protected:
+
+  AuditRecFieldsParser *_parserFor(int recType) const {
+    const DispatchTable *table = table_.get();
+    if (table == nullptr) {
+      return nullptr;
+    }
+    if (recType >= 0 && recType < MAX_TABLE_TYPE) {
+      return table->byType[recType];
+    }
+    for (auto parser : table->parsers) {
+      if (parser->handlesType(recType)) {
+        return parser;
       }
+    }
+    return nullptr;
+  }
 
-      // add entry to dest
+  void _build() {
+    if (addedParsers_.empty()) {
+      return;
+    }
+    std::unique_ptr<DispatchTable> spTable(new DispatchTable());
+    for (auto spParser : addedParsers_) {
+      spTable->parsers.push_back(spParser.get());
+    }
+    for (int recType = 0; recType < MAX_TABLE_TYPE; recType++) {
+      spTable->byType[recType] = nullptr;
+      for (auto parser : spTable->parsers) {
+        if (parser->handlesType(recType)) {
+          spTable->byType[recType] = parser;
+          break;
+        }
+      }
+    }
+    table_ = std::move(spTable);
+  }
 
-      auto key = std::string(start, (keyEnd - start));
-      string_offsets_t entry;
-      entry.start = (uint32_t)(valueStart - body);
-      entry.len = (uint32_t)(p - valueStart);
-      entry.isQuoted = isQuoted;
+    AuditRecTokenizer tokenizer_;
+    // in lookup order
+    std::vector<std::shared_ptr<AuditRecFieldsParser> > addedParsers_;
+    std::unique_ptr<const DispatchTable> table_;
+};
 
+struct SELinuxFieldsParser : public AuditRecFieldsParser {
+  explicit SELinuxFieldsParser(AuditRecTokenizer tokenizer = AuditRecTokenizer()) : tokenizer_(tokenizer) {}
+  virtual ~SELinuxFieldsParser() {}
+  bool handlesType(int recType) override {
+    return (recType == 1107 || (recType >= 1400 && recType <= 1450));
+  }
+  bool parseFields(int /*recType*/, const char *body, int bodylen, AuditRecFieldIndex &dest) override {
+    int i=0;
+    return tokenizer_.tokenize(body, bodylen,
+        [this, &i, &dest](const char *key, size_t keylen, const string_offsets_t &entry) {
       if (i++ == 0) {
         // the first key is where the special handling comes into play
-        handleSpecialIntro(key, entry, dest);
+        handleSpecialIntro(key, keylen, entry, dest);
       } else {
-        dest[key] = entry;
+        dest.add(key, keylen, entry);
       }
-
-      // advance
-
-      start = p + (isQuoted ? 2 : 1);
-    }
-    return false;
+      return true;
+    });
   }
 
   // cases:
@@ -193,29 +644,32 @@ struct SELinuxFieldsParser : public AuditRecFieldsParser {
   //   'policy loaded auid=0 ses=2' # _policy_status=loaded
   //   'netlabel: auid=0 ses=2 '  # _sel_prefix='netlabel'
   //   'user pid=1169'  # _sel_prefix='user'
-  void handleSpecialIntro(std::string &key, string_offsets_t &entry, std::map<std::string, string_offsets_t> &dest) {
+  void handleSpecialIntro(const char *key, size_t keylen, const string_offsets_t &entry, AuditRecFieldIndex &dest) {
 
-    std::size_t posLastSpace = key.rfind(" ");
-    std::size_t posFirstSpace = key.find(" ");
-    if (posLastSpace == std::string::npos) {
+    const char *pFirstSpace = (const char *)memchr(key, ' ', keylen);
+    if (pFirstSpace == nullptr) {
       // use verbatim
-      dest[key] = entry;
+      dest.add(key, keylen, entry);
       return;
     }
+    std::size_t posFirstSpace = pFirstSpace - key;
+    std::size_t posLastSpace = keylen - 1;
+    while (key[posLastSpace] != ' ') {
+      posLastSpace--;
+    }
 
-
-    std::string actualKey = key.substr(posLastSpace+1);
-    dest[actualKey] = entry;
+    // actual key follows last space
+    dest.add(key + posLastSpace + 1, keylen - posLastSpace - 1, entry);
 
     // now handle special info
 
-    const char *end = key.data() + posLastSpace;
+    const char *end = key + posLastSpace;
 
     // prefix only?  'user' or 'netlabel:'
 
     if (posFirstSpace == posLastSpace) {
       //std::string prefix = key.substr(0, posFirstSpace);
-      dest["_sel_prefix"] = string_offsets_t({0, (uint32_t)posFirstSpace});
+      dest.add("_sel_prefix", string_offsets_t({0, (uint32_t)posFirstSpace, false, VALUE_PLAIN}));
       return;
     }
 
@@ -223,7 +677,7 @@ struct SELinuxFieldsParser : public AuditRecFieldsParser {
 
     if (posFirstSpace == 4 && key[0] == 'a' && key[3] == ':') {
       // find status
-      const char *p = key.data() + 5;
+      const char *p = key + 5;
       const char *start = p;
       while (p < end && *p != ' ') {
         p++;
@@ -232,7 +686,7 @@ struct SELinuxFieldsParser : public AuditRecFieldsParser {
         return;  // did not find
       }
       //std::string avcStatus = key.substr(5,(p-start));
-      dest["_avc_status"] = string_offsets_t({5,(uint32_t)(p-start)});
+      dest.add("_avc_status", string_offsets_t({5, (uint32_t)(p-start), false, VALUE_PLAIN}));
 
       start = p + 3;
       p = start;
@@ -244,17 +698,30 @@ struct SELinuxFieldsParser : public AuditRecFieldsParser {
         return;  // did not find
       }
       //std::string avcOp = key.substr(start-key.data(),(p-start-1));
-      dest["_avc_op"] = string_offsets_t({(uint32_t)(start-key.data()),(uint32_t)(p-start-1)});
+      dest.add("_avc_op", string_offsets_t({(uint32_t)(start-key), (uint32_t)(p-start-1), false, VALUE_PLAIN}));
     }
     else if (posFirstSpace == 6 && key[0] == 'p' && key[5] == 'y') {
       //std::string policyStatus = key.substr(posFirstSpace+1,posLastSpace-posFirstSpace-1);
-      dest["_policy_status"] = string_offsets_t({(uint32_t)(posFirstSpace+1),(uint32_t)(posLastSpace-posFirstSpace-1)});
+      dest.add("_policy_status", string_offsets_t({(uint32_t)(posFirstSpace+1), (uint32_t)(posLastSpace-posFirstSpace-1), false, VALUE_PLAIN}));
     }
   }
+
+protected:
+  AuditRecTokenizer tokenizer_;
 };
 
+typedef std::shared_ptr<const AuditRecParsers> SPAuditRecParsers;
+
 namespace {
-std::shared_ptr<AuditRecFieldsParser> SELinuxFieldsParserNew() {
-  return std::make_shared<SELinuxFieldsParser>();
+std::shared_ptr<AuditRecFieldsParser> SELinuxFieldsParserNew(AuditRecTokenizer tokenizer = AuditRecTokenizer()) {
+  return std::make_shared<SELinuxFieldsParser>(tokenizer);
+}
+
+/*
+ * e.g. AuditCollectorNew(listener, 500, AuditRecParsersNew({SELinuxFieldsParserNew()}))
+ */
+SPAuditRecParsers AuditRecParsersNew(std::initializer_list<std::shared_ptr<AuditRecFieldsParser> > parsers = {},
+                                     AuditRecTokenizer tokenizer = AuditRecTokenizer()) {
+  return std::make_shared<const AuditRecParsers>(parsers, tokenizer);
 }
 }
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "hexi_simd.hpp"
+
+/*
+ * Forward-only character class scanner over a record body, used by
+ * the field tokenizers.
+ *
+ * The body is processed in 64-byte blocks.  For each block a single
+ * pass of SIMD compares produces one bitmask per class ('=', ' ', '"',
+ * '\'' and hex digits), so finding the next delimiter is a shift and
+ * count of trailing zeros instead of a byte loop, and checking that a
+ * value is all hex is a mask test.  Blocks are loaded on demand, so a
+ * tokenizer that stops early never scans the rest of the body.
+ */
+struct AuditRecScanner {
+
+  enum CharClass {
+    CLASS_EQUALS = 0,
+    CLASS_SPACE,
+    CLASS_DQUOTE,
+    CLASS_SQUOTE,
+    CLASS_HEX,
+    CLASS_COUNT
+  };
+
+  typedef void (*block_fn)(const char *block, uint64_t *masks);
+
+  AuditRecScanner(const char *body, size_t len) : body_(body), len_(len),
+      blockBase_((size_t)-1), maskFn_(_blockFn()) {
+  }
+
+  /*
+   * @return position of first char of class cls at or after from,
+   * or len if there is none.
+   */
+  size_t find(int cls, size_t from) {
+    while (from < len_) {
+      size_t base = from & ~(size_t)63;
+      if (base != blockBase_) {
+        _load(base);
+      }
+      uint64_t bits = masks_[cls] >> (from - base);
+      if (bits != 0) {
+        size_t pos = from + (size_t)__builtin_ctzll(bits);
+        return (pos < len_) ? pos : len_;
+      }
+      from = base + 64;
+    }
+    return len_;
+  }
+
+  /*
+   * Like find(), also setting allHex to whether every char in
+   * [from, result) is a hex digit.
+   */
+  size_t find(int cls, size_t from, bool &allHex) {
+    uint64_t nonHex = 0;
+    while (from < len_) {
+      size_t base = from & ~(size_t)63;
+      if (base != blockBase_) {
+        _load(base);
+      }
+      const size_t shift = from - base;
+      uint64_t bits = masks_[cls] >> shift;
+      uint64_t nh = ~masks_[CLASS_HEX] >> shift;
+      if (base + 64 > len_) {
+        // ignore padding
+        nh &= (1ULL << (len_ - from)) - 1;
+      }
+      if (bits != 0) {
+        size_t n = (size_t)__builtin_ctzll(bits);
+        allHex = (nonHex | (nh & ((1ULL << n) - 1))) == 0;
+        return from + n;
+      }
+      nonHex |= nh;
+      from = base + 64;
+    }
+    allHex = (nonHex == 0);
+    return len_;
+  }
+
+  static int classOf(char c) {
+    switch (c) {
+      case '=': return CLASS_EQUALS;
+      case ' ': return CLASS_SPACE;
+      case '"': return CLASS_DQUOTE;
+      case '\'': return CLASS_SQUOTE;
+      default: return -1;
+    }
+  }
+
+  static bool isHexDigit(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+  }
+
+  static void blockScalar(const char *block, uint64_t *masks) {
+    for (int c = 0; c < CLASS_COUNT; c++) {
+      masks[c] = 0;
+    }
+    for (int i = 0; i < 64; i++) {
+      int cls = classOf(block[i]);
+      if (cls >= 0) {
+        masks[cls] |= 1ULL << i;
+      }
+      if (isHexDigit(block[i])) {
+        masks[CLASS_HEX] |= 1ULL << i;
+      }
+    }
+  }
+
+#ifdef HEXI_X86_SIMD
+
+  __attribute__((target("sse2")))
+  static void blockSSE2(const char *block, uint64_t *masks) {
+    const __m128i eq = _mm_set1_epi8('=');
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i dq = _mm_set1_epi8('"');
+    const __m128i sq = _mm_set1_epi8('\'');
+    uint64_t m[CLASS_COUNT] = {0, 0, 0, 0, 0};
+    for (int i = 0; i < 4; i++) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(block + i * 16));
+      __m128i bad = _mm_setzero_si128();
+      HexiSimd::nibbles128<true>(v, bad);
+      m[CLASS_HEX] |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) << (i * 16);
+      m[CLASS_EQUALS] |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, eq)) << (i * 16);
+      m[CLASS_SPACE] |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, sp)) << (i * 16);
+      m[CLASS_DQUOTE] |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, dq)) << (i * 16);
+      m[CLASS_SQUOTE] |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, sq)) << (i * 16);
+    }
+    memcpy(masks, m, sizeof(m));
+  }
+
+  __attribute__((target("avx2")))
+  static void blockAVX2(const char *block, uint64_t *masks) {
+    const __m256i eq = _mm256_set1_epi8('=');
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i dq = _mm256_set1_epi8('"');
+    const __m256i sq = _mm256_set1_epi8('\'');
+    __m256i lo = _mm256_loadu_si256((const __m256i *)block);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(block + 32));
+    masks[CLASS_EQUALS] = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, eq)) |
+                          (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, eq)) << 32;
+    masks[CLASS_SPACE] = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, sp)) |
+                         (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, sp)) << 32;
+    masks[CLASS_DQUOTE] = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, dq)) |
+                          (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, dq)) << 32;
+    masks[CLASS_SQUOTE] = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, sq)) |
+                          (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, sq)) << 32;
+    __m256i badlo = _mm256_setzero_si256(), badhi = _mm256_setzero_si256();
+    HexiSimd::nibbles256<true>(lo, badlo);
+    HexiSimd::nibbles256<true>(hi, badhi);
+    masks[CLASS_HEX] = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(badlo, _mm256_setzero_si256())) |
+                       (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(badhi, _mm256_setzero_si256())) << 32;
+  }
+
+#endif // HEXI_X86_SIMD
+
+  static bool isVectorized() {
+    return _blockFn() != &AuditRecScanner::blockScalar;
+  }
+
+protected:
+
+  /*
+   * The last block is copied to a zero padded buffer, so kernels can
+   * always read 64 bytes.  Padding bits are beyond len and ignored.
+   */
+  void _load(size_t base) {
+    blockBase_ = base;
+    if (base + 64 <= len_) {
+      maskFn_(body_ + base, masks_);
+    } else {
+      char tmp[64];
+      memset(tmp, 0, sizeof(tmp));
+      memcpy(tmp, body_ + base, len_ - base);
+      maskFn_(tmp, masks_);
+    }
+  }
+
+  static block_fn _selectBlockFn() {
+#ifdef HEXI_X86_SIMD
+    if (HexiSimd::hasAVX2()) return &AuditRecScanner::blockAVX2;
+    if (HexiSimd::hasSSE2()) return &AuditRecScanner::blockSSE2;
+#endif
+    return &AuditRecScanner::blockScalar;
+  }
+
+  static block_fn _blockFn() {
+    static block_fn fn = _selectBlockFn();
+    return fn;
+  }
+
+  const char *body_;
+  size_t      len_;
+  size_t      blockBase_;
+  block_fn    maskFn_;
+  uint64_t    masks_[CLASS_COUNT];
+};
@@ -0,0 +1,386 @@
+#pragma once
+
+#include <string.h>
+#include <atomic>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Parser for the high-volume record types, whose keys come in a
+ * known order:
+ *   1300 SYSCALL, 1302 PATH, 1306 SOCKADDR, 1307 CWD, 1320 EOE, 1327 PROCTITLE
+ *
+ * Instead of searching for '=' and hashing every key, each key is
+ * checked against the next expected one with a short memcmp, and index
+ * entries are added with the precomputed hash and ID.  Keys missing
+ * from the record (e.g. inode..rdev in PATH records of unnamed items)
+ * are skipped over.  At the first key that is not in the schema, the
+ * rest of the body goes through the generic tokenizer, so the result
+ * is always the same as DefaultAuditRecFieldParser, except that
+ * unquoted values of matched keys are only classified when first read,
+ * see string_offsets_t::encodingOf().
+ *
+ * Usage:
+ *   AuditCollectorNew(listener, 500, AuditRecParsersNew({FixedSchemaFieldsParserNew()}))
+ */
+struct FixedSchemaFieldsParser : public AuditRecFieldsParser {
+
+  struct Key {
+    const char   *name;
+    uint32_t      len;
+    uint32_t      hash;
+    AuditFieldId  id;
+  };
+
+  struct Schema {
+    std::vector<Key> keys;
+  };
+
+  explicit FixedSchemaFieldsParser(AuditRecTokenizer tokenizer = AuditRecTokenizer()) : tokenizer_(tokenizer) {}
+  virtual ~FixedSchemaFieldsParser() {}
+
+  bool handlesType(int recType) override {
+    return schemaFor(recType) != nullptr;
+  }
+
+  bool parsesNested() override {
+    return false;
+  }
+
+  bool parseFields(int recType, const char *body, int bodylen, AuditRecFieldIndex &dest) override {
+    const Schema *schema = schemaFor(recType);
+    if (schema == nullptr) {
+      return tokenizer_.parseFields(body, bodylen, dest);
+    }
+    return parse(*schema, body, bodylen, dest);
+  }
+
+  /**
+   * @param matched If not null, set to false when the body did not
+   *                fit the schema and the generic tokenizer was used.
+   * @return true on parse error, false on success
+   */
+  bool parse(const Schema &schema, const char *body, int bodylen, AuditRecFieldIndex &dest,
+             bool *matched = nullptr) const {
+    if (matched != nullptr) {
+      *matched = true;
+    }
+    const size_t len = (size_t)bodylen;
+    size_t start;
+    if (match(schema, body, len, dest, start)) {
+      return true;
+    }
+    if (start >= len) {
+      return false;
+    }
+    if (matched != nullptr) {
+      *matched = false;
+    }
+    return tokenizeRest(tokenizer_, body, len, start, dest);
+  }
+
+  /**
+   * Indexes body while its keys fit schema.
+   * @param stop Set to where the body stopped fitting, or len if it
+   *             fit to the end.
+   * @return true on parse error, false otherwise
+   */
+  static bool match(const Schema &schema, const char *body, size_t len, AuditRecFieldIndex &dest,
+                    size_t &stop) {
+    const size_t nkeys = schema.keys.size();
+    size_t start = 0;
+    size_t k = 0;
+
+    while (start < len) {
+
+      // match expected key, skipping any that are absent
+
+      size_t m = k;
+      while (m < nkeys && !_isKeyAt(schema.keys[m], body + start, len - start)) {
+        m++;
+      }
+      if (m == nkeys) {
+        break;
+      }
+      const Key &key = schema.keys[m];
+      k = m + 1;
+
+      size_t p = start + key.len + 1;
+      if (p == len) {
+        stop = len;
+        return true;
+      }
+      size_t valueStart = p;
+      bool isQuoted = false;
+      char endChar = ' ';
+      if (body[p] == '"' || body[p] == '\'') {
+        isQuoted = true;
+        endChar = body[p];
+        p++;
+        valueStart = p;
+      }
+      const char *pend = (const char *)memchr(body + p, endChar, len - p);
+      p = (pend == nullptr) ? len : (size_t)(pend - body);
+
+      string_offsets_t entry;
+      entry.start = (uint32_t)valueStart;
+      entry.len = (uint32_t)(p - valueStart);
+      entry.isQuoted = isQuoted;
+      // most values are never decoded, classify on first read
+      entry.encoding = isQuoted ? (uint8_t)VALUE_QUOTED : (uint8_t)string_offsets_t::ENCODING_DEFERRED;
+      dest.add(body + start, key.len, key.hash, key.id, entry);
+
+      start = p + (isQuoted ? 2 : 1);
+    }
+    stop = start;
+    return false;
+  }
+
+  /**
+   * Indexes body from start, where it stopped fitting a schema, with
+   * the generic tokenizer.
+   */
+  static bool tokenizeRest(const AuditRecTokenizer &tokenizer, const char *body, size_t len, size_t start,
+                           AuditRecFieldIndex &dest) {
+    return tokenizer.tokenize(body + start, (int)(len - start),
+        [&dest, start](const char *key, size_t keylen, const string_offsets_t &value) {
+      string_offsets_t entry = value;
+      entry.start += (uint32_t)start;
+      dest.add(key, keylen, entry);
+      return true;
+    });
+  }
+
+  /*
+   * @return schema for recType, or nullptr if not one of the fixed types.
+   */
+  static const Schema *schemaFor(int recType) {
+    switch (recType) {
+      case 1300: {
+        static const Schema schema = _make({FID_ARCH, FID_SYSCALL, FID_SUCCESS, FID_EXIT,
+            FID_A0, FID_A1, FID_A2, FID_A3, FID_ITEMS, FID_PPID, FID_PID, FID_AUID,
+            FID_UID, FID_GID, FID_EUID, FID_SUID, FID_FSUID, FID_EGID, FID_SGID, FID_FSGID,
+            FID_TTY, FID_SES, FID_COMM, FID_EXE, FID_SUBJ, FID_KEY});
+        return &schema;
+      }
+      case 1302: {
+        static const Schema schema = _make({FID_ITEM, FID_NAME, FID_INODE, FID_DEV, FID_MODE,
+            FID_OUID, FID_OGID, FID_RDEV, FID_OBJ, FID_NAMETYPE, FID_CAP_FP, FID_CAP_FI,
+            FID_CAP_FE, FID_CAP_FVER, FID_CAP_FROOTID});
+        return &schema;
+      }
+      case 1306: {
+        static const Schema schema = _make({FID_SADDR});
+        return &schema;
+      }
+      case 1307: {
+        static const Schema schema = _make({FID_CWD});
+        return &schema;
+      }
+      case 1320: {
+        static const Schema schema = _make({});
+        return &schema;
+      }
+      case 1327: {
+        static const Schema schema = _make({FID_PROCTITLE});
+        return &schema;
+      }
+      default:
+        return nullptr;
+    }
+  }
+
+protected:
+
+  static Schema _make(std::initializer_list<AuditFieldId> ids) {
+    Schema schema;
+    for (auto id : ids) {
+      const char *name = AuditFieldIds::name(id);
+      Key key = {name, (uint32_t)strlen(name), 0, id};
+      key.hash = AuditFieldIds::hash(name, key.len);
+      schema.keys.push_back(key);
+    }
+    return schema;
+  }
+
+  static bool _isKeyAt(const Key &key, const char *p, size_t avail) {
+    return avail > key.len && p[key.len] == '=' && memcmp(p, key.name, key.len) == 0;
+  }
+
+  AuditRecTokenizer tokenizer_;
+};
+
+/*
+ * Learns the key layouts of each record type from the records parsed,
+ * and parses later records of that type with
+ * FixedSchemaFieldsParser::match() against the learned layouts, up to
+ * LAYOUTS_PER_TYPE of them, e.g. SYSCALL records with and without
+ * subj.  A record that fits none of them (a miss) is finished by the
+ * generic tokenizer, and its layout is learned into a free slot.  Once
+ * all slots are in use, a layout is only replaced after
+ * REPLACE_AFTER_MISSES misses in a row, so record types with many
+ * layouts do not allocate on every record.  Since absent keys are
+ * skipped, records whose keys are a subset of a learned layout, in the
+ * same order, still hit.
+ *
+ * Learned layouts are published through atomic pointers, so parsing
+ * takes no lock.  Replaced layouts are kept until the parser is
+ * destroyed, since other threads may still be using them, and
+ * learning stops after MAX_LEARNED layouts.
+ *
+ * Handles record types minType..maxType, by default the kernel audit
+ * event range (1300..1399), leaving SELinux and user messages to other
+ * parsers.
+ */
+struct ShapeCacheFieldsParser : public AuditRecFieldsParser {
+  enum : size_t { MAX_LEARNED = 1024, LAYOUTS_PER_TYPE = 4, REPLACE_AFTER_MISSES = 16 };
+
+  ShapeCacheFieldsParser(int minType = 1300, int maxType = 1399,
+                         AuditRecTokenizer tokenizer = AuditRecTokenizer()) : minType_(minType),
+      maxType_(maxType), tokenizer_(tokenizer), types_(new TypeShapes[maxType - minType + 1]),
+      mutex_(), retired_(), hits_(0), misses_(0) {
+    for (int i = 0; i <= maxType_ - minType_; i++) {
+      for (size_t w = 0; w < LAYOUTS_PER_TYPE; w++) {
+        types_[i].layouts[w].store(nullptr);
+      }
+      types_[i].misses.store(0);
+      types_[i].victim.store(0);
+    }
+  }
+
+  virtual ~ShapeCacheFieldsParser() {}
+
+  bool handlesType(int recType) override {
+    return recType >= minType_ && recType <= maxType_;
+  }
+
+  // nested values would learn layouts that no record has
+  bool parsesNested() override {
+    return false;
+  }
+
+  bool parseFields(int recType, const char *body, int bodylen, AuditRecFieldIndex &dest) override {
+    if (!handlesType(recType)) {
+      return tokenizer_.parseFields(body, bodylen, dest);
+    }
+    TypeShapes &shapes = types_[recType - minType_];
+    const size_t len = (size_t)bodylen;
+    // other layouts are only tried if a failed one can be undone
+    const bool canRetry = dest.empty();
+    const bool partial = dest.isPartial();
+    size_t stop = 0;
+    size_t w = 0;
+    for (; w < LAYOUTS_PER_TYPE; w++) {
+      const Shape *shape = shapes.layouts[w].load(std::memory_order_acquire);
+      if (shape == nullptr || (w > 0 && !canRetry)) {
+        break;
+      }
+      if (w > 0) {
+        dest.clear();
+        dest.setPartial(partial);
+      }
+      bool err = FixedSchemaFieldsParser::match(shape->schema, body, len, dest, stop);
+      if (err || stop >= len) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        if (shapes.misses.load(std::memory_order_relaxed) != 0) {
+          shapes.misses.store(0, std::memory_order_relaxed);
+        }
+        return err;
+      }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    bool status = (w == 0) ? tokenizer_.parseFields(body, bodylen, dest)
+                           : FixedSchemaFieldsParser::tokenizeRest(tokenizer_, body, len, stop, dest);
+    if (!status) {
+      _learn(shapes, dest);
+    }
+    return status;
+  }
+
+  uint64_t getHits() const {
+    return hits_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t getMisses() const {
+    return misses_.load(std::memory_order_relaxed);
+  }
+
+  /*
+   * Number of layouts learned so far, including replaced ones.
+   */
+  size_t getNumLearned() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return retired_.size();
+  }
+
+protected:
+
+  struct Shape {
+    std::string                      names;  // backing text for schema key names
+    FixedSchemaFieldsParser::Schema  schema;
+  };
+
+  struct TypeShapes {
+    std::atomic<const Shape *> layouts[LAYOUTS_PER_TYPE];
+    std::atomic<uint32_t>      misses;   // in a row, while all layouts are in use
+    std::atomic<uint32_t>      victim;   // next layout to replace
+  };
+
+  void _learn(TypeShapes &shapes, const AuditRecFieldIndex &fields) {
+    size_t w = 0;
+    while (w < LAYOUTS_PER_TYPE && shapes.layouts[w].load(std::memory_order_relaxed) != nullptr) {
+      w++;
+    }
+    if (w == LAYOUTS_PER_TYPE) {
+      if (shapes.misses.fetch_add(1, std::memory_order_relaxed) + 1 < REPLACE_AFTER_MISSES) {
+        return;
+      }
+      shapes.misses.store(0, std::memory_order_relaxed);
+      w = shapes.victim.fetch_add(1, std::memory_order_relaxed) % LAYOUTS_PER_TYPE;
+    }
+
+    std::unique_ptr<Shape> spShape(new Shape());
+    for (size_t i = 0; i < fields.size(); i++) {
+      spShape->names.append(fields.at(i).key, fields.at(i).keylen);
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < fields.size(); i++) {
+      auto &entry = fields.at(i);
+      FixedSchemaFieldsParser::Key key = {spShape->names.data() + offset, entry.keylen, entry.hash,
+                                          (AuditFieldId)entry.id};
+      spShape->schema.keys.push_back(key);
+      offset += entry.keylen;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (retired_.size() >= MAX_LEARNED) {
+      // layouts keep changing, stop learning rather than grow
+      return;
+    }
+    shapes.layouts[w].store(spShape.get(), std::memory_order_release);
+    retired_.push_back(std::move(spShape));
+  }
+
+  const int minType_;
+  const int maxType_;
+  const AuditRecTokenizer tokenizer_;
+  std::unique_ptr<TypeShapes[]> types_;
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Shape> > retired_;
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+};
+
+namespace {
+std::shared_ptr<AuditRecFieldsParser> FixedSchemaFieldsParserNew(AuditRecTokenizer tokenizer = AuditRecTokenizer()) {
+  return std::make_shared<FixedSchemaFieldsParser>(tokenizer);
+}
+
+std::shared_ptr<ShapeCacheFieldsParser> ShapeCacheFieldsParserNew(int minType = 1300, int maxType = 1399,
+                                                                  AuditRecTokenizer tokenizer = AuditRecTokenizer()) {
+  return std::make_shared<ShapeCacheFieldsParser>(minType, maxType, tokenizer);
+}
+}
@@ -1,15 +1,23 @@
 #pragma once
 
 #include <stdint.h>
+#include <string.h>
 #include <string>
+#include <vector>
 #include "hexi.hpp"
 
+/*
+ * Result of AuditParseUtils::parseSockAddr().
+ * Plain data, so it can be reused and stored in bulk without allocation.
+ * Text forms are produced on request, see ip4FromSaddr() and ip6FromSaddr().
+ */
 struct SockAddrInfo {
   uint32_t port;
   uint32_t addr4;
   uint8_t family;
-  std::string addr6;
-  std::string socketid;
+  uint8_t isAbstract;   // unix socket name in abstract namespace (leading NUL dropped)
+  uint16_t pathlen;     // bytes of decoded unix socket path written to pathbuf
+  uint8_t addr6[16];    // IPv6 address, network byte order
 };
 
 struct AuditParseUtils {
@@ -18,16 +26,138 @@ struct AuditParseUtils {
   static const int FAM_IPV6 = 0xA;
   static const int FAM_UNIXSOCKET = 1;
 
+  // sun_path size, large enough for any decoded unix socket path
+  static const int UNIX_PATH_MAX = 108;
+
+  /*
+   * Status of numeric parsing.
+   */
+  enum NumStatus {
+    NUM_OK = 0,
+    NUM_NOT_FOUND,
+    NUM_MALFORMED,
+    NUM_OVERFLOW
+  };
+
+  /*
+   * Parse decimal number with optional leading '-', e.g. "exit=-2".
+   * dest is only set on NUM_OK.
+   */
+  static int parseInt64(const char *str, size_t len, int64_t &dest) {
+    bool negative = (len > 0 && str[0] == '-');
+    uint64_t value;
+    int status = parseUInt64(str + negative, len - negative, value);
+    if (status != NUM_OK) {
+      return status;
+    }
+    const uint64_t limit = (uint64_t)INT64_MAX + (negative ? 1 : 0);
+    if (value > limit) {
+      return NUM_OVERFLOW;
+    }
+    dest = negative ? (int64_t)(0 - value) : (int64_t)value;
+    return NUM_OK;
+  }
+
+  /*
+   * Parse unsigned decimal number, e.g. "auid=4294967295".
+   * dest is only set on NUM_OK.
+   */
+  static int parseUInt64(const char *str, size_t len, uint64_t &dest) {
+    if (len == 0) {
+      return NUM_MALFORMED;
+    }
+    uint64_t value = 0;
+    bool overflow = false;
+    for (size_t i = 0; i < len; i++) {
+      uint32_t digit = (uint32_t)(uint8_t)str[i] - '0';
+      if (digit > 9) {
+        return NUM_MALFORMED;
+      }
+      overflow |= (value > (UINT64_MAX - digit) / 10);
+      value = value * 10 + digit;
+    }
+    if (overflow) {
+      return NUM_OVERFLOW;
+    }
+    dest = value;
+    return NUM_OK;
+  }
+
+  /*
+   * Parse exactly len decimal digits (len <= 19), e.g. fixed-width
+   * timestamp parts of the record preamble.  Eight digits at a time
+   * are validated and combined in a 64-bit word.
+   * dest is only set on NUM_OK.
+   */
+  static int parseFixedDigits(const char *str, size_t len, uint64_t &dest) {
+    if (len == 0 || len > 19) {
+      return NUM_MALFORMED;
+    }
+    uint64_t value = 0;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+      uint32_t chunk;
+      if (!_parse8Digits(str + i, chunk)) {
+        return NUM_MALFORMED;
+      }
+      value = value * 100000000ULL + chunk;
+    }
+    for (; i < len; i++) {
+      uint32_t digit = (uint32_t)(uint8_t)str[i] - '0';
+      if (digit > 9) {
+        return NUM_MALFORMED;
+      }
+      value = value * 10 + digit;
+    }
+    dest = value;
+    return NUM_OK;
+  }
+
+  /*
+   * Parse hex number without prefix, e.g. "arch=c000003e" or "a1=7fdf339232a0".
+   * dest is only set on NUM_OK.
+   */
+  static int parseHex64(const char *str, size_t len, uint64_t &dest) {
+    if (len == 0) {
+      return NUM_MALFORMED;
+    }
+    uint64_t value = 0;
+    uint64_t high = 0;
+    uint8_t flags = 0;
+    for (size_t i = 0; i < len; i++) {
+      high |= value >> 60;
+      value = (value << 4) | Hexi::parseNibble(str[i], flags);
+    }
+    if (flags & Hexi::INVALID_NIBBLE) {
+      return NUM_MALFORMED;
+    }
+    if (high != 0) {
+      return NUM_OVERFLOW;
+    }
+    dest = value;
+    return NUM_OK;
+  }
+
   /*
    * Parse audit netlink saddr
+   * Returns false if saddr is too short, not a supported family,
+   * or contains non-hex chars where hex is expected.
+   *
+   * For unix sockets, the decoded path is written to pathbuf (not
+   * null-terminated) and its length set in dest.pathlen.  Paths longer
+   * than pathbufsize are truncated.  If pathbuf is NULL, only family
+   * and isAbstract are set.
    */
-  static bool parseSockAddr(const char *saddr, size_t len, SockAddrInfo &dest) {
+  static bool parseSockAddr(const char *saddr, size_t len, SockAddrInfo &dest,
+                            char *pathbuf = nullptr, size_t pathbufsize = 0) {
 
     if (len <= 4) {
       return false;
     }
 
-    dest.family = Hexi::parseU8(saddr);
+    if (Hexi::checkedParseU8(saddr, dest.family) != Hexi::VALID) {
+      return false;
+    }
 
     switch (dest.family) {
       case FAM_IPV4 : {
@@ -35,8 +165,14 @@ struct AuditParseUtils {
         if (len < 16) {
           return false;
         }
-        dest.port = Hexi::parseU16(saddr + 4);
-        dest.addr4 = Hexi::parseU32(saddr + 8);
+        uint16_t port;
+        uint32_t addr4;
+        if (Hexi::checkedParseU16(saddr + 4, port) != Hexi::VALID ||
+            Hexi::checkedParseU32(saddr + 8, addr4) != Hexi::VALID) {
+          return false;
+        }
+        dest.port = port;
+        dest.addr4 = addr4;
       }
       break;
 
@@ -44,21 +180,14 @@ struct AuditParseUtils {
         if (len < (16 + 32)) {
           return false;
         }
-        dest.port = Hexi::parseU16(saddr + 4);
-        char tmp[48];
-        char *p = tmp;
-        const char *src = saddr + 16;
-        for (size_t i = 0; i < 8; ++i) {
-          *p++ = tolower(*src++);
-          *p++ = tolower(*src++);
-          *p++ = tolower(*src++);
-          *p++ = tolower(*src++);
-          if (i == 0 || i % 7 != 0) {
-            *p++ = ':';
-          }
+        uint16_t port;
+        uint8_t addr6[16];
+        if (Hexi::checkedParseU16(saddr + 4, port) != Hexi::VALID ||
+            Hexi::checkedHex2ascii((char *)addr6, sizeof(addr6), saddr + 16, 32) != Hexi::VALID) {
+          return false;
         }
-        *p = 0;
-        dest.addr6 = std::string(tmp);
+        dest.port = port;
+        memcpy(dest.addr6, addr6, sizeof(addr6));
       }
       break;
 
@@ -68,11 +197,32 @@ struct AuditParseUtils {
           return false;
         }
 
-        off_t begin = (saddr[4] == '0' && saddr[5] == '0') ? 6 : 4;
-        auto end = strstr(saddr + begin, "00");
-        end = (end == NULL) ? saddr + len : end;
-        dest.socketid = std::string(saddr + begin, end);
+        // abstract names start with a NUL and may contain more of them,
+        // pathnames end at the first NUL.
+
+        dest.isAbstract = (saddr[4] == '0' && saddr[5] == '0') ? 1 : 0;
+        dest.pathlen = 0;
+
+        if (pathbuf == nullptr) {
+          break;
+        }
 
+        const char *src = saddr + (dest.isAbstract ? 6 : 4);
+        size_t srclen = (len - (src - saddr)) & ~(size_t)1;
+        if (srclen / 2 > pathbufsize) {
+          srclen = pathbufsize * 2;
+        }
+        if (Hexi::checkedHex2ascii(pathbuf, pathbufsize, src, srclen) != Hexi::VALID) {
+          return false;
+        }
+        size_t pathlen = srclen / 2;
+        if (!dest.isAbstract) {
+          const char *nul = (const char *)memchr(pathbuf, 0, pathlen);
+          if (nul != NULL) {
+            pathlen = nul - pathbuf;
+          }
+        }
+        dest.pathlen = (uint16_t)pathlen;
       }
       break;
       default:
@@ -81,13 +231,128 @@ struct AuditParseUtils {
     return true;
   }
 
+  // buffer sizes for formatIp4(), formatIp6() and formatPort(), including NUL
+  static const int IP4_TEXT_MAX = 16;
+  static const int IP6_TEXT_MAX = 46;
+  static const int PORT_TEXT_MAX = 6;
+
+  /*
+   * Writes dotted-quad text of addr to dest, null-terminated.
+   * addr is in host order, as in SockAddrInfo.addr4.
+   * dest must hold IP4_TEXT_MAX chars.
+   * @return length of text
+   */
+  static size_t formatIp4(char *dest, uint32_t addr) {
+    char *p = dest;
+    p = _appendOctet(p, (addr >> 24) & 0x00FF);
+    *p++ = '.';
+    p = _appendOctet(p, (addr >> 16) & 0x00FF);
+    *p++ = '.';
+    p = _appendOctet(p, (addr >> 8) & 0x00FF);
+    *p++ = '.';
+    p = _appendOctet(p, addr & 0x00FF);
+    *p = 0;
+    return p - dest;
+  }
+
+  /*
+   * Writes RFC 5952 text of addr6 to dest, null-terminated:
+   * lowercase, no leading zeros, longest run of two or more zero groups
+   * (first one on a tie) replaced with "::", and IPv4-mapped addresses
+   * in "::ffff:a.b.c.d" form.
+   * dest must hold IP6_TEXT_MAX chars.
+   * @return length of text
+   */
+  static size_t formatIp6(char *dest, const uint8_t *addr6) {
+    uint16_t groups[8];
+    for (int i = 0; i < 8; i++) {
+      groups[i] = (uint16_t)(addr6[i * 2] << 8 | addr6[i * 2 + 1]);
+    }
+
+    char *p = dest;
+
+    if (groups[0] == 0 && groups[1] == 0 && groups[2] == 0 && groups[3] == 0 &&
+        groups[4] == 0 && groups[5] == 0xFFFF) {
+      memcpy(p, "::ffff:", 7);
+      p += 7;
+      uint32_t addr4 = (uint32_t)groups[6] << 16 | groups[7];
+      return (p - dest) + formatIp4(p, addr4);
+    }
+
+    // find longest run of zero groups
+
+    int bestStart = -1, bestLen = 1;
+    for (int i = 0; i < 8; ) {
+      if (groups[i] != 0) { i++; continue; }
+      int j = i;
+      while (j < 8 && groups[j] == 0) j++;
+      if (j - i > bestLen) {
+        bestStart = i;
+        bestLen = j - i;
+      }
+      i = j;
+    }
+
+    for (int i = 0; i < 8; i++) {
+      if (i == bestStart) {
+        *p++ = ':';
+        *p++ = ':';
+        i += bestLen - 1;
+        continue;
+      }
+      if (i > 0 && i != bestStart + bestLen) {
+        *p++ = ':';
+      }
+      p = _appendHexGroup(p, groups[i]);
+    }
+    *p = 0;
+    return p - dest;
+  }
+
+  /*
+   * Writes decimal port to dest, null-terminated.
+   * dest must hold PORT_TEXT_MAX chars.
+   * @return length of text
+   */
+  static size_t formatPort(char *dest, uint32_t port) {
+    port &= 0xFFFF;
+    const char *pairs = _digitPairs();
+    char tmp[8];
+    char *p = tmp + sizeof(tmp);
+    while (port >= 100) {
+      uint32_t r = port % 100;
+      port /= 100;
+      p -= 2;
+      memcpy(p, pairs + r * 2, 2);
+    }
+    if (port >= 10) {
+      p -= 2;
+      memcpy(p, pairs + port * 2, 2);
+    } else {
+      *--p = (char)('0' + port);
+    }
+    size_t len = (tmp + sizeof(tmp)) - p;
+    memcpy(dest, p, len);
+    dest[len] = 0;
+    return len;
+  }
+
   /*
    * Can't use inet_ntoa or inet_ptoa, since addr is not network endian
    */
   static std::string ip4FromSaddr(uint32_t addr) {
-    char tmp[32];
-    snprintf(tmp,sizeof(tmp), "%d.%d.%d.%d", (addr >> 24)& 0x00FF, (addr >> 16)& 0x00FF, (addr >> 8) & 0x00FF, addr & 0x00FF);
-    return std::string(tmp);
+    char tmp[IP4_TEXT_MAX];
+    size_t len = formatIp4(tmp, addr);
+    return std::string(tmp, len);
+  }
+
+  /*
+   * RFC 5952 text form of addr6, e.g. "2406:da00:ff00::34cc:ea4a"
+   */
+  static std::string ip6FromSaddr(const uint8_t *addr6) {
+    char tmp[IP6_TEXT_MAX];
+    size_t len = formatIp6(tmp, addr6);
+    return std::string(tmp, len);
   }
 
   /// concatenate the value strings for fields in message of type
@@ -166,4 +431,226 @@ struct AuditParseUtils {
   }
 
 
+protected:
+
+  /*
+   * Decimal text of 0..255, 4 bytes per entry: up to 3 digits, then length.
+   */
+  static bool _initOctetTable(char *table) {
+    for (int i = 0; i < 256; i++) {
+      char *e = table + i * 4;
+      if (i >= 100) {
+        e[0] = (char)('0' + i / 100); e[1] = (char)('0' + (i / 10) % 10); e[2] = (char)('0' + i % 10); e[3] = 3;
+      } else if (i >= 10) {
+        e[0] = (char)('0' + i / 10); e[1] = (char)('0' + i % 10); e[2] = 0; e[3] = 2;
+      } else {
+        e[0] = (char)('0' + i); e[1] = 0; e[2] = 0; e[3] = 1;
+      }
+    }
+    return true;
+  }
+  static const char *_octetTable() {
+    static char table[256 * 4];
+    static bool isInitialized = _initOctetTable(table);
+    return table;
+  }
+
+  static const char *_digitPairs() {
+    return "00010203040506070809"
+           "10111213141516171819"
+           "20212223242526272829"
+           "30313233343536373839"
+           "40414243444546474849"
+           "50515253545556575859"
+           "60616263646566676869"
+           "70717273747576777879"
+           "80818283848586878889"
+           "90919293949596979899";
+  }
+
+  // copies 3 bytes, callers' buffers always have room past the digits
+  static inline char *_appendOctet(char *p, uint32_t octet) {
+    const char *e = _octetTable() + octet * 4;
+    memcpy(p, e, 3);
+    return p + e[3];
+  }
+
+  static inline bool _parse8Digits(const char *str, uint32_t &dest) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t val;
+    memcpy(&val, str, 8);
+    // every byte 0x30..0x39
+    if ((((val & 0xF0F0F0F0F0F0F0F0ULL) |
+          (((val + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) != 0x3333333333333333ULL)) {
+      return false;
+    }
+    val -= 0x3030303030303030ULL;
+    val = (val * 10) + (val >> 8);  // pairs of digits
+    val = (((val & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+           (((val >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+    dest = (uint32_t)val;
+    return true;
+#else
+    uint32_t value = 0;
+    for (int i = 0; i < 8; i++) {
+      uint32_t digit = (uint32_t)(uint8_t)str[i] - '0';
+      if (digit > 9) {
+        return false;
+      }
+      value = value * 10 + digit;
+    }
+    dest = value;
+    return true;
+#endif
+  }
+
+  static inline char *_appendHexGroup(char *p, uint16_t v) {
+    static const char digits[] = "0123456789abcdef";
+    if (v >= 0x1000) *p++ = digits[v >> 12];
+    if (v >= 0x100) *p++ = digits[(v >> 8) & 0x0F];
+    if (v >= 0x10) *p++ = digits[(v >> 4) & 0x0F];
+    *p++ = digits[v & 0x0F];
+    return p;
+  }
+
+};
+
+/*
+ * One saddr field value, e.g. from AuditRecGroup::getField("saddr", ..).
+ */
+struct SockAddrSpan {
+  const char *saddr;
+  size_t      len;
+};
+
+/*
+ * Structure-of-arrays output of SockAddrBatchParser::parse().
+ * Each array must hold one entry per input span.
+ * addr6 may be NULL if the caller does not want IPv6 addresses.
+ */
+struct SockAddrBatch {
+  uint8_t  *family;     // 0 if the saddr could not be parsed
+  uint16_t *port;
+  uint32_t *addr4;
+  uint8_t (*addr6)[16];
+};
+
+/*
+ * Decodes many saddr values at once.
+ * A first pass reads and checks the family of every record, and groups
+ * record indexes by family.  The port and address hex of the IPv4 group,
+ * usually most of the records, is gathered into one contiguous buffer
+ * and decoded with a single Hexi::checkedHex2ascii() call, so it runs
+ * through the vector kernels.  Unix socket records only get family set,
+ * use AuditParseUtils::parseSockAddr() for their paths.
+ *
+ * Keeps its grouping scratch space between calls, so reuse the instance.
+ * Not thread-safe.
+ */
+struct SockAddrBatchParser {
+  SockAddrBatchParser() : v4_(), v6_(), v4hex_(), v4bin_() {}
+
+  /**
+   * @return number of records successfully parsed.
+   */
+  size_t parse(const SockAddrSpan *spans, size_t count, SockAddrBatch &dest) {
+    v4_.clear();
+    v6_.clear();
+    size_t numParsed = 0;
+
+    for (size_t i = 0; i < count; i++) {
+      const SockAddrSpan &span = spans[i];
+      uint8_t family = 0;
+      dest.port[i] = 0;
+      dest.addr4[i] = 0;
+      if (dest.addr6 != nullptr) {
+        memset(dest.addr6[i], 0, 16);
+      }
+      if (span.len > 4 && Hexi::checkedParseU8(span.saddr, family) == Hexi::VALID) {
+        switch (family) {
+          case AuditParseUtils::FAM_IPV4:
+            if (span.len >= 16) { v4_.push_back((uint32_t)i); } else { family = 0; }
+            break;
+          case AuditParseUtils::FAM_IPV6:
+            if (span.len >= 16 + 32) { v6_.push_back((uint32_t)i); } else { family = 0; }
+            break;
+          case AuditParseUtils::FAM_UNIXSOCKET:
+            if (span.len > 6) { numParsed++; } else { family = 0; }
+            break;
+          default:
+            family = 0;
+            break;
+        }
+      }
+      dest.family[i] = family;
+    }
+
+    numParsed += _parseIp4(spans, dest);
+
+    for (size_t j = 0; j < v6_.size(); j++) {
+      uint32_t i = v6_[j];
+      const char *saddr = spans[i].saddr;
+      uint8_t flags = 0;
+      uint8_t addr6[16];
+      uint16_t port = Hexi::parseU16(saddr + 4, flags);
+      if ((flags & Hexi::INVALID_NIBBLE) != 0 ||
+          Hexi::checkedHex2ascii((char *)addr6, sizeof(addr6), saddr + 16, 32) != Hexi::VALID) {
+        dest.family[i] = 0;
+        continue;
+      }
+      dest.port[i] = port;
+      if (dest.addr6 != nullptr) {
+        memcpy(dest.addr6[i], addr6, sizeof(addr6));
+      }
+      numParsed++;
+    }
+    return numParsed;
+  }
+
+protected:
+
+  /*
+   * Each IPv4 record gets a 16-char row in v4hex_: "0000", then its
+   * port and address hex, decoding to 8 bytes in v4bin_.  A record with
+   * a non-hex char stops the decode, which resumes at the next row.
+   */
+  size_t _parseIp4(const SockAddrSpan *spans, SockAddrBatch &dest) {
+    const size_t n = v4_.size();
+    v4hex_.resize(n * 16);
+    v4bin_.resize(n * 8);
+    for (size_t j = 0; j < n; j++) {
+      char *row = &v4hex_[j * 16];
+      memcpy(row, "0000", 4);
+      memcpy(row + 4, spans[v4_[j]].saddr + 4, 12);
+    }
+
+    size_t numParsed = n;
+    size_t pos = 0;
+    while (pos < n * 16) {
+      size_t rv = Hexi::checkedHex2ascii((char *)&v4bin_[pos / 2], n * 8 - pos / 2, &v4hex_[pos], n * 16 - pos);
+      if (rv == Hexi::VALID) {
+        break;
+      }
+      size_t j = (pos + rv) / 16;
+      dest.family[v4_[j]] = 0;
+      numParsed--;
+      pos = (j + 1) * 16;
+    }
+
+    for (size_t j = 0; j < n; j++) {
+      uint32_t i = v4_[j];
+      if (dest.family[i] == 0) {
+        continue;
+      }
+      const uint8_t *bin = &v4bin_[j * 8];
+      dest.port[i] = (uint16_t)(bin[2] << 8 | bin[3]);
+      dest.addr4[i] = (uint32_t)bin[4] << 24 | (uint32_t)bin[5] << 16 | (uint32_t)bin[6] << 8 | bin[7];
+    }
+    return numParsed;
+  }
+
+  std::vector<uint32_t> v4_;
+  std::vector<uint32_t> v6_;
+  std::vector<char>     v4hex_;
+  std::vector<uint8_t>  v4bin_;
 };
@@ -1,6 +1,26 @@
 #pragma once
 
+#include "hexi_simd.hpp"
+
 struct Hexi {
+
+  /*
+   * hex2ascii() decode implementations.  The best supported one is
+   * selected once from cpuid, IMPL_SCALAR is always available.
+   */
+  enum DecodeImpl {
+    IMPL_SCALAR = 0,
+    IMPL_SSE2,
+    IMPL_SSSE3,
+    IMPL_AVX2,
+    IMPL_COUNT
+  };
+
+  /*
+   * Returned by the checked*() functions when all input was valid hex.
+   */
+  enum : size_t { VALID = HexiSimd::VALID };
+
   /*
    * Parse 2-char hex to byte.
    * Caller must ensure str has length.
@@ -36,6 +56,66 @@ struct Hexi {
     return val;
   }
 
+  /*
+   * Validating variants of parseU8/16/32.
+   * Caller must ensure str has length.
+   * dest is only set when all chars are hex digits.
+   * @return Hexi::VALID on success, otherwise offset of first non-hex char.
+   */
+  static size_t checkedParseU8(const char *str, uint8_t &dest) {
+    uint32_t val;
+    size_t rv = _checkedParse(str, 2, val);
+    if (rv == VALID) { dest = (uint8_t)val; }
+    return rv;
+  }
+
+  static size_t checkedParseU16(const char *str, uint16_t &dest) {
+    uint32_t val;
+    size_t rv = _checkedParse(str, 4, val);
+    if (rv == VALID) { dest = (uint16_t)val; }
+    return rv;
+  }
+
+  static size_t checkedParseU32(const char *str, uint32_t &dest) {
+    return _checkedParse(str, 8, dest);
+  }
+
+  /*
+   * Branch-free variants for tight loops over many values.
+   * Any non-hex char sets the INVALID_NIBBLE bit in flags, which
+   * the caller tests once afterwards.
+   */
+  static const uint8_t INVALID_NIBBLE = 0x10;
+
+  static inline uint16_t parseU16(const char *str, uint8_t &flags) {
+    uint8_t n0 = VVAL(str[0]), n1 = VVAL(str[1]), n2 = VVAL(str[2]), n3 = VVAL(str[3]);
+    flags |= n0 | n1 | n2 | n3;
+    return (uint16_t)((n0 & 0x0F) << 12 | (n1 & 0x0F) << 8 | (n2 & 0x0F) << 4 | (n3 & 0x0F));
+  }
+
+  static inline uint8_t parseNibble(const char c, uint8_t &flags) {
+    uint8_t n = VVAL(c);
+    flags |= n;
+    return n & 0x0F;
+  }
+
+  static inline uint32_t parseU32(const char *str, uint8_t &flags) {
+    uint32_t hi = parseU16(str, flags);
+    return hi << 16 | parseU16(str + 4, flags);
+  }
+
+  /**
+   * @return true if all len chars of psrc are hex digits.
+   */
+  static bool isHex(const char *psrc, size_t len) {
+    const uint8_t *lut = _vlut();
+    uint8_t flags = 0;
+    for (size_t i = 0; i < len; i++) {
+      flags |= lut[(uint8_t)psrc[i]];
+    }
+    return (flags & INVALID_NIBBLE) == 0;
+  }
+
   /**
    * decodes hex-encoded string
    * @return true on error, false on success.
@@ -53,17 +133,171 @@ struct Hexi {
     if (srclen < 2 || srclen % 2 == 1 || destlen < (srclen / 2)) {
       return true;
     }
-    const char *pend = psrc + srclen;
-    int i=0;
-    while (psrc < pend) {
-      pdest[i++] = parseU8(psrc);
-      psrc += 2;
+#if defined(HEXI_X86_SIMD) && defined(__SSE2__)
+    if (srclen >= 16 && srclen <= 64) {
+      HexiSimd::decodeShort<false>((uint8_t *)pdest, psrc, srclen / 2);
+      return false;
+    }
+#endif
+    _decode(_decoder(), pdest, psrc, srclen / 2);
+    return false;
+  }
+
+  /**
+   * Same as above, using a specific implementation.
+   * Falls back to scalar if impl is not supported on this CPU.
+   */
+  static bool hex2ascii(DecodeImpl impl, char *pdest, size_t destlen, const char *psrc, size_t srclen) {
+    if (srclen < 2 || srclen % 2 == 1 || destlen < (srclen / 2)) {
+      return true;
     }
+    _decode(_kernel(impl), pdest, psrc, srclen / 2);
     return false;
   }
 
+  /**
+   * Validating decode.  Decodes min(srclen, destlen * 2) chars, dest is
+   * unspecified from the first char that is not a hex digit on.
+   * @return Hexi::VALID if all of psrc was decoded, otherwise the offset
+   * of the first char not decoded: a non-hex char, an unpaired last char,
+   * or the point where dest ran out of room.
+   * Validation adds one OR per vector and a test at the end, so this
+   * costs about the same as hex2ascii(); the offset of a non-hex char
+   * is only looked for on failure.
+   */
+  static size_t checkedHex2ascii(char *pdest, size_t destlen, const char *psrc, size_t srclen) {
+#if defined(HEXI_X86_SIMD) && defined(__SSE2__)
+    // short values, e.g. saddr and most paths, skip dispatch
+    if (srclen >= 16 && srclen <= 64 && srclen % 2 == 0 && destlen >= srclen / 2) {
+      return HexiSimd::decodeShort<true>((uint8_t *)pdest, psrc, srclen / 2);
+    }
+#endif
+    return _checkedDecode(_checkedDecoder(), pdest, destlen, psrc, srclen);
+  }
+
+  static size_t checkedHex2ascii(DecodeImpl impl, char *pdest, size_t destlen, const char *psrc, size_t srclen) {
+    return _checkedDecode(_kernel(impl, true), pdest, destlen, psrc, srclen);
+  }
+
+  static bool isSupported(DecodeImpl impl) {
+    switch (impl) {
+      case IMPL_SCALAR: return true;
+      case IMPL_SSE2: return HexiSimd::hasSSE2();
+      case IMPL_SSSE3: return HexiSimd::hasSSSE3();
+      case IMPL_AVX2: return HexiSimd::hasAVX2();
+      default: return false;
+    }
+  }
+
+  static DecodeImpl bestImpl() {
+    static DecodeImpl best = _selectImpl();
+    return best;
+  }
+
+  static const char *implName(DecodeImpl impl) {
+    switch (impl) {
+      case IMPL_SCALAR: return "scalar";
+      case IMPL_SSE2: return "sse2";
+      case IMPL_SSSE3: return "ssse3";
+      case IMPL_AVX2: return "avx2";
+      default: return "unknown";
+    }
+  }
+
 
 protected:
+  static DecodeImpl _selectImpl() {
+    if (isSupported(IMPL_AVX2)) return IMPL_AVX2;
+    if (isSupported(IMPL_SSSE3)) return IMPL_SSSE3;
+    if (isSupported(IMPL_SSE2)) return IMPL_SSE2;
+    return IMPL_SCALAR;
+  }
+
+  static HexiSimd::decode_fn _kernel(DecodeImpl impl, bool check = false) {
+    HexiSimd::decode_fn none = check ? &_checkedScalar : &HexiSimd::decodeNone;
+    if (!isSupported(impl)) {
+      return none;
+    }
+    switch (impl) {
+#ifdef HEXI_X86_SIMD
+      case IMPL_SSE2: return check ? &HexiSimd::decodeSSE2<true> : &HexiSimd::decodeSSE2<false>;
+      case IMPL_SSSE3: return check ? &HexiSimd::decodeSSSE3<true> : &HexiSimd::decodeSSSE3<false>;
+      case IMPL_AVX2: return check ? &HexiSimd::decodeAVX2<true> : &HexiSimd::decodeAVX2<false>;
+#endif
+      default: return none;
+    }
+  }
+
+  static HexiSimd::decode_fn _decoder() {
+    static HexiSimd::decode_fn fn = _kernel(bestImpl());
+    return fn;
+  }
+
+  static HexiSimd::decode_fn _checkedDecoder() {
+    static HexiSimd::decode_fn fn = _kernel(bestImpl(), true);
+    return fn;
+  }
+
+  /*
+   * Vector kernel handles whole blocks, lookup table does the rest.
+   */
+  static void _decode(HexiSimd::decode_fn fn, char *pdest, const char *psrc, size_t npairs) {
+    size_t i = fn((uint8_t *)pdest, psrc, npairs);
+    for (; i < npairs; i++) {
+      pdest[i] = parseU8(psrc + i * 2);
+    }
+  }
+
+  /*
+   * Checked kernels decode all of npairs themselves, inputs too short
+   * for them go to the lookup table.
+   */
+  static size_t _checkedDecode(HexiSimd::decode_fn fn, char *pdest, size_t destlen, const char *psrc, size_t srclen) {
+    size_t npairs = srclen / 2;
+    if (npairs > destlen) {
+      npairs = destlen;
+    }
+    if (npairs < HexiSimd::MIN_CHECKED_PAIRS) {
+      fn = &_checkedScalar;
+    }
+    size_t rv = fn((uint8_t *)pdest, psrc, npairs);
+    if (rv == VALID && npairs * 2 < srclen) {
+      return npairs * 2;
+    }
+    return rv;
+  }
+
+  static size_t _checkedScalar(uint8_t *pdest, const char *psrc, size_t npairs) {
+    for (size_t i = 0; i < npairs; i++) {
+      uint8_t hi = VVAL(psrc[i * 2]);
+      uint8_t lo = VVAL(psrc[i * 2 + 1]);
+      if ((hi | lo) & INVALID_NIBBLE) {
+        return (hi & INVALID_NIBBLE) ? i * 2 : i * 2 + 1;
+      }
+      pdest[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return VALID;
+  }
+
+  static size_t _checkedParse(const char *str, int nchars, uint32_t &dest) {
+    uint32_t val = 0;
+    uint8_t flags = 0;
+    for (int i=0; i < nchars; i++) {
+      uint8_t n = VVAL(str[i]);
+      flags |= n;
+      val = (val << 4) | (n & 0x0F);
+    }
+    if (flags & INVALID_NIBBLE) {
+      for (int i=0; i < nchars; i++) {
+        if (VVAL(str[i]) & INVALID_NIBBLE) {
+          return (size_t)i;
+        }
+      }
+    }
+    dest = val;
+    return VALID;
+  }
+
   static bool _initLut(uint8_t *lut) {
     for (int i=0; i < 256; i++) { lut[i] = (uint8_t)0; }
     for (auto i='0'; i <= '9'; i++) { lut[(int)i] = (uint8_t)(i - '0'); }
@@ -80,4 +314,24 @@ protected:
     return _lut()[(uint8_t)c];
   }
 
+  /*
+   * Validating table: same as _lut(), but non-hex chars map to INVALID_NIBBLE.
+   */
+
+  static bool _initValidatingLut(uint8_t *lut) {
+    _initLut(lut);
+    for (int i=0; i < 256; i++) {
+      if (lut[i] == 0 && i != '0') { lut[i] = INVALID_NIBBLE; }
+    }
+    return true;
+  }
+  static uint8_t* _vlut() {
+    static uint8_t lut[256];
+    static bool isInitialized=_initValidatingLut(lut);
+    return lut;
+  }
+  static inline uint8_t VVAL(const char c) {
+    return _vlut()[(uint8_t)c];
+  }
+
 };
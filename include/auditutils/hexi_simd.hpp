@@ -0,0 +1,244 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(HEXI_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HEXI_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/*
+ * Vectorized hex decode kernels used by Hexi::hex2ascii().
+ *
+ * Each kernel decodes whole blocks only and returns the number of hex
+ * pairs (output bytes) it consumed.  The caller finishes the remaining
+ * tail with the scalar lookup table.  The validating (CHECK) flavor
+ * needs at least MIN_CHECKED_PAIRS and decodes all of them, its last
+ * block overlapping the one before, and returns VALID or the offset
+ * of the first non-hex char; dest is unspecified from there on.
+ * Otherwise non-hex characters decode to a zero nibble, exactly like
+ * Hexi::CVAL(), so every kernel produces identical output to the
+ * scalar path.
+ *
+ * Kernels are compiled with function-level target attributes, so no
+ * special compiler flags are needed.  Hexi picks one at runtime from cpuid.
+ */
+struct HexiSimd {
+
+  typedef size_t (*decode_fn)(uint8_t *dest, const char *src, size_t npairs);
+
+  // VALID is the same as Hexi::VALID
+  enum : size_t { VALID = (size_t)-1, MIN_CHECKED_PAIRS = 8 };
+
+  static size_t decodeNone(uint8_t *, const char *, size_t) {
+    return 0;
+  }
+
+#ifdef HEXI_X86_SIMD
+
+  static bool hasSSE2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+  }
+
+  static bool hasSSSE3() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+  }
+
+  static bool hasAVX2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+  }
+
+  /*
+   * 16 hex chars -> 16 nibble values (0..15) in the same byte positions.
+   * Each char is decoded both as a digit and as a letter, and for a
+   * hex digit the smaller value, unsigned, is the right one.  Other
+   * chars get a nonzero byte in bad, which zeroes their nibble, or
+   * with CHECK is or-ed into acc and leaves the nibble unspecified.
+   */
+  template <bool CHECK>
+  __attribute__((target("sse2")))
+  static inline __m128i nibbles128(__m128i c, __m128i &acc) {
+    const __m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    const __m128i x = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    const __m128i n = _mm_min_epu8(d, _mm_add_epi8(x, _mm_set1_epi8(10)));
+    const __m128i bad = _mm_min_epu8(_mm_subs_epu8(d, _mm_set1_epi8(9)), _mm_subs_epu8(x, _mm_set1_epi8(5)));
+    if (CHECK) {
+      acc = _mm_or_si128(acc, bad);
+      return n;
+    }
+    return _mm_and_si128(n, _mm_cmpeq_epi8(bad, _mm_setzero_si128()));
+  }
+
+  template <bool CHECK>
+  __attribute__((target("avx2")))
+  static inline __m256i nibbles256(__m256i c, __m256i &acc) {
+    const __m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+    const __m256i x = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    const __m256i n = _mm256_min_epu8(d, _mm256_add_epi8(x, _mm256_set1_epi8(10)));
+    const __m256i bad = _mm256_min_epu8(_mm256_subs_epu8(d, _mm256_set1_epi8(9)),
+                                        _mm256_subs_epu8(x, _mm256_set1_epi8(5)));
+    if (CHECK) {
+      acc = _mm256_or_si256(acc, bad);
+      return n;
+    }
+    return _mm256_and_si256(n, _mm256_cmpeq_epi8(bad, _mm256_setzero_si256()));
+  }
+
+  /*
+   * Combine nibble pairs into bytes, one per 16-bit lane (0..255).
+   * SSE2 has no byte multiply, so shift and or.
+   */
+  __attribute__((target("sse2")))
+  static inline __m128i pairs128_sse2(__m128i n) {
+    return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n, _mm_set1_epi16(0x00FF)), 4),
+                        _mm_srli_epi16(n, 8));
+  }
+
+  __attribute__((target("ssse3")))
+  static inline __m128i pairs128_ssse3(__m128i n) {
+    return _mm_maddubs_epi16(n, _mm_set1_epi16(0x0110));
+  }
+
+  /*
+   * With CHECK, the bad bytes of all blocks are or-ed together and
+   * tested once at the end, keeping the loops branch free.  The offset
+   * of a non-hex char is only looked for once the test fails.
+   */
+  __attribute__((target("sse2")))
+  static inline size_t checkResult(__m128i acc, const char *src, size_t npairs) {
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) == 0xFFFF) {
+      return VALID;
+    }
+    return findInvalid(src, npairs * 2);
+  }
+
+  /*
+   * @return offset of the first non-hex char in nchars (at least 16)
+   * of src, or VALID.
+   */
+  __attribute__((target("sse2"), noinline))
+  static size_t findInvalid(const char *src, size_t nchars) {
+    size_t i = 0;
+    for (;;) {
+      __m128i bad = _mm_setzero_si128();
+      nibbles128<true>(_mm_loadu_si128((const __m128i *)(src + i)), bad);
+      unsigned mask = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) & 0xFFFF;
+      if (mask != 0) {
+        return i + __builtin_ctz(mask);
+      }
+      if (i + 16 == nchars) {
+        return VALID;
+      }
+      i = (i + 32 <= nchars) ? i + 16 : nchars - 16;
+    }
+  }
+
+  template <bool CHECK>
+  __attribute__((target("sse2")))
+  static size_t decodeSSE2(uint8_t *dest, const char *src, size_t npairs) {
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= npairs; i += 16) {
+      __m128i a = pairs128_sse2(nibbles128<CHECK>(_mm_loadu_si128((const __m128i *)(src + i * 2)), acc));
+      __m128i b = pairs128_sse2(nibbles128<CHECK>(_mm_loadu_si128((const __m128i *)(src + i * 2 + 16)), acc));
+      _mm_storeu_si128((__m128i *)(dest + i), _mm_packus_epi16(a, b));
+    }
+    for (; i + 8 <= npairs || (CHECK && i < npairs); i += 8) {
+      if (i + 8 > npairs) {
+        i = npairs - 8;
+      }
+      __m128i a = pairs128_sse2(nibbles128<CHECK>(_mm_loadu_si128((const __m128i *)(src + i * 2)), acc));
+      _mm_storel_epi64((__m128i *)(dest + i), _mm_packus_epi16(a, a));
+    }
+    return CHECK ? checkResult(acc, src, npairs) : i;
+  }
+
+  template <bool CHECK>
+  __attribute__((target("ssse3")))
+  static size_t decodeSSSE3(uint8_t *dest, const char *src, size_t npairs) {
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= npairs; i += 16) {
+      __m128i a = pairs128_ssse3(nibbles128<CHECK>(_mm_loadu_si128((const __m128i *)(src + i * 2)), acc));
+      __m128i b = pairs128_ssse3(nibbles128<CHECK>(_mm_loadu_si128((const __m128i *)(src + i * 2 + 16)), acc));
+      _mm_storeu_si128((__m128i *)(dest + i), _mm_packus_epi16(a, b));
+    }
+    for (; i + 8 <= npairs || (CHECK && i < npairs); i += 8) {
+      if (i + 8 > npairs) {
+        i = npairs - 8;
+      }
+      __m128i a = pairs128_ssse3(nibbles128<CHECK>(_mm_loadu_si128((const __m128i *)(src + i * 2)), acc));
+      _mm_storel_epi64((__m128i *)(dest + i), _mm_packus_epi16(a, a));
+    }
+    return CHECK ? checkResult(acc, src, npairs) : i;
+  }
+
+  template <bool CHECK>
+  __attribute__((target("avx2")))
+  static size_t decodeAVX2(uint8_t *dest, const char *src, size_t npairs) {
+    __m256i acc256 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= npairs; i += 32) {
+      const __m256i weights = _mm256_set1_epi16(0x0110);
+      __m256i a = _mm256_maddubs_epi16(nibbles256<CHECK>(_mm256_loadu_si256((const __m256i *)(src + i * 2)), acc256), weights);
+      __m256i b = _mm256_maddubs_epi16(nibbles256<CHECK>(_mm256_loadu_si256((const __m256i *)(src + i * 2 + 32)), acc256), weights);
+      // packus works per 128-bit lane, so restore order afterwards
+      __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+      _mm256_storeu_si256((__m256i *)(dest + i), packed);
+    }
+    // finish short inputs and tails with 128-bit steps
+    __m128i acc = _mm_or_si128(_mm256_castsi256_si128(acc256), _mm256_extracti128_si256(acc256, 1));
+    for (; i + 16 <= npairs; i += 16) {
+      __m128i a = pairs128_ssse3(nibbles128<CHECK>(_mm_loadu_si128((const __m128i *)(src + i * 2)), acc));
+      __m128i b = pairs128_ssse3(nibbles128<CHECK>(_mm_loadu_si128((const __m128i *)(src + i * 2 + 16)), acc));
+      _mm_storeu_si128((__m128i *)(dest + i), _mm_packus_epi16(a, b));
+    }
+    for (; i + 8 <= npairs || (CHECK && i < npairs); i += 8) {
+      if (i + 8 > npairs) {
+        i = npairs - 8;
+      }
+      __m128i a = pairs128_ssse3(nibbles128<CHECK>(_mm_loadu_si128((const __m128i *)(src + i * 2)), acc));
+      _mm_storel_epi64((__m128i *)(dest + i), _mm_packus_epi16(a, a));
+    }
+    return CHECK ? checkResult(acc, src, npairs) : i;
+  }
+
+#ifdef __SSE2__
+
+  /*
+   * Decodes 8..32 pairs in 8-pair blocks, the last one overlapping
+   * the one before, so short inputs such as saddr values need no
+   * dispatch and no scalar tail.  With CHECK, validity of all blocks
+   * is tested once at the end.  SSE2 is part of the compile target,
+   * so this inlines into callers.
+   * @return VALID, or with CHECK the offset of the first non-hex char
+   */
+  template <bool CHECK>
+  static inline size_t decodeShort(uint8_t *dest, const char *src, size_t npairs) {
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (;;) {
+      __m128i a = pairs128_sse2(nibbles128<CHECK>(_mm_loadu_si128((const __m128i *)(src + i * 2)), acc));
+      _mm_storel_epi64((__m128i *)(dest + i), _mm_packus_epi16(a, a));
+      if (i + 8 == npairs) {
+        break;
+      }
+      i = (i + 16 <= npairs) ? i + 8 : npairs - 8;
+    }
+    return CHECK ? checkResult(acc, src, npairs) : VALID;
+  }
+
+#endif // __SSE2__
+
+#else
+
+  static bool hasSSE2() { return false; }
+  static bool hasSSSE3() { return false; }
+  static bool hasAVX2() { return false; }
+
+#endif // HEXI_X86_SIMD
+};
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
+#include <atomic>
 #include <string>
+#include <thread>
 #include <auditutils/auditrec_parser.hpp>
 #include "test_defs.h"
 
@@ -70,3 +72,337 @@ TEST_F(AuditRecAllocatorTests, dups) {
   ASSERT_EQ(2, spa->poolSize());
   
 }
+
+TEST_F(AuditRecAllocatorTests, mpmc_queue) {
+  AuditMPMCQueue<int> q(5);
+  EXPECT_EQ(8, q.capacity());
+  int v;
+  EXPECT_FALSE(q.pop(v));
+  for (int i = 0; i < 8; i++) {
+    v = i;
+    EXPECT_TRUE(q.push(v));
+  }
+  v = 8;
+  EXPECT_FALSE(q.push(v));
+  for (int i = 0; i < 8; i++) {
+    EXPECT_TRUE(q.pop(v));
+    EXPECT_EQ(i, v);
+  }
+  EXPECT_FALSE(q.pop(v));
+}
+
+TEST_F(AuditRecAllocatorTests, thread_cache) {
+  auto spa = std::make_shared<AuditRecAllocator>(500);
+
+  audit_reply reply;
+  FILL_REPLY(reply, rec1);
+
+  std::vector<SPAuditRecBuf> bufs;
+  for (int i = 0; i < 100; i++) {
+    bufs.push_back(spa->alloc(reply.msg, reply.type, reply.len));
+    ASSERT_TRUE(bufs.back() != nullptr);
+  }
+  for (auto &spBuf : bufs) {
+    spa->recycle(spBuf);
+  }
+  EXPECT_EQ(100, spa->poolSize());
+
+  // buffers recycled here are reused by another thread, except for
+  // the ones still in this thread's cache
+
+  std::thread t([&bufs, &spa, &reply]() {
+    for (auto &spBuf : bufs) {
+      spBuf = spa->alloc(reply.msg, reply.type, reply.len);
+    }
+  });
+  t.join();
+  size_t numCached = spa->poolSize();
+  EXPECT_LE(numCached, (size_t)AuditRecAllocator::MAX_CACHED);
+  EXPECT_EQ(0, strncmp(rec1.msg.c_str(), bufs[99]->data(), bufs[99]->size()));
+  for (auto &spBuf : bufs) {
+    spa->recycle(spBuf);
+  }
+  EXPECT_EQ(100 + numCached, spa->poolSize());
+  bufs.clear();
+
+  // other allocators do not get each other's buffers
+
+  auto spb = std::make_shared<AuditRecAllocator>(500);
+  auto spBuf = spb->alloc(reply.msg, reply.type, reply.len);
+  EXPECT_EQ(100 + numCached, spa->poolSize());
+  EXPECT_EQ(0, spb->poolSize());
+  spb->recycle(spBuf);
+  EXPECT_EQ(1, spb->poolSize());
+  spBuf = spa->alloc(reply.msg, reply.type, reply.len);
+  EXPECT_EQ(99 + numCached, spa->poolSize());
+  EXPECT_EQ(1, spb->poolSize());
+}
+
+TEST_F(AuditRecAllocatorTests, thread_cache_per_allocator) {
+  auto spa = std::make_shared<AuditRecAllocator>(500);
+  auto spb = std::make_shared<AuditRecAllocator>(500);
+
+  audit_reply reply;
+  FILL_REPLY(reply, rec1);
+
+  std::vector<SPAuditRecBuf> bufs;
+  for (int i = 0; i < 10; i++) {
+    bufs.push_back(spa->alloc(reply.msg, reply.type, reply.len));
+  }
+  for (auto &spBuf : bufs) {
+    spa->recycle(spBuf);
+  }
+
+  // using another allocator keeps spa's buffers in this thread's cache,
+  // so another thread has to create its own
+
+  auto spBuf = spb->alloc(reply.msg, reply.type, reply.len);
+  spb->recycle(spBuf);
+
+  std::thread t([&bufs, &spa, &reply]() {
+    for (auto &spBuf : bufs) {
+      spBuf = spa->alloc(reply.msg, reply.type, reply.len);
+    }
+    for (auto &spBuf : bufs) {
+      spa->recycle(spBuf);
+    }
+  });
+  t.join();
+  EXPECT_EQ(20, spa->getStats(0).numCreated);
+
+  // and this thread still reuses them
+  spBuf = spa->alloc(reply.msg, reply.type, reply.len);
+  EXPECT_EQ(20, spa->getStats(0).numCreated);
+  EXPECT_EQ(1, spa->getStats(0).numReused);
+  spa->recycle(spBuf);
+
+  // more allocators than caches hand back the oldest cache
+  std::vector<std::shared_ptr<AuditRecAllocator> > others;
+  for (size_t i = 0; i < AuditRecAllocator::THREAD_CACHES; i++) {
+    others.push_back(std::make_shared<AuditRecAllocator>(500));
+    spBuf = others.back()->alloc(reply.msg, reply.type, reply.len);
+    others.back()->recycle(spBuf);
+  }
+  std::thread t2([&bufs, &spa, &reply]() {
+    for (auto &spBuf : bufs) {
+      spBuf = spa->alloc(reply.msg, reply.type, reply.len);
+    }
+  });
+  t2.join();
+  EXPECT_EQ(20, spa->getStats(0).numCreated);
+}
+
+/*
+ * Reader threads allocate and hand buffers to consumer threads, which
+ * recycle them, like onAuditRecord() and release() on a busy system.
+ */
+TEST_F(AuditRecAllocatorTests, contention) {
+  // buffers allocated on one thread and recycled on another; timing is
+  // in bench_records alloc
+  const int NUM_PAIRS = 2;
+  const int NUM_ALLOCS = 2000;
+  auto spa = std::make_shared<AuditRecAllocator>(500);
+  AuditMPMCQueue<SPAuditRecBuf> handoff(256);
+  std::atomic<int> numFailed(0);
+  std::atomic<int> numDone(0);
+
+  audit_reply reply;
+  FILL_REPLY(reply, rec1);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < NUM_PAIRS; i++) {
+    threads.push_back(std::thread([&]() {
+      for (int n = 0; n < NUM_ALLOCS; n++) {
+        SPAuditRecBuf spBuf = spa->alloc(reply.msg, reply.type, reply.len);
+        if (spBuf == nullptr) {
+          numFailed++;
+          std::this_thread::yield();
+          continue;
+        }
+        while (!handoff.push(spBuf)) {
+          std::this_thread::yield();
+        }
+      }
+      numDone++;
+    }));
+    threads.push_back(std::thread([&]() {
+      SPAuditRecBuf spBuf;
+      for (;;) {
+        if (handoff.pop(spBuf)) {
+          spa->recycle(spBuf);
+          spBuf.reset();
+        } else if (numDone == NUM_PAIRS) {
+          break;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }));
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  SPAuditRecBuf spBuf;
+  while (handoff.pop(spBuf)) {
+    spa->recycle(spBuf);
+  }
+  spBuf.reset();
+
+  // every buffer handed out came back exactly once
+  auto stats = spa->getStats(0);
+  EXPECT_EQ((uint64_t)(NUM_PAIRS * NUM_ALLOCS), stats.numReused + stats.numCreated);
+  EXPECT_EQ((uint64_t)numFailed.load(), stats.numFailed);
+  EXPECT_EQ(stats.numCreated - stats.numDropped, stats.numFree);
+  EXPECT_EQ(stats.numAllocated, stats.numFree);
+  EXPECT_EQ(stats.numFree, spa->poolSize());
+  EXPECT_LE(spa->poolSize(), 500);
+}
+
+TEST_F(AuditRecAllocatorTests, size_classes) {
+  EXPECT_EQ(0, AuditRecAllocator::sizeClassOf(26));
+  EXPECT_EQ(0, AuditRecAllocator::sizeClassOf(512));
+  EXPECT_EQ(1, AuditRecAllocator::sizeClassOf(513));
+  EXPECT_EQ(4, AuditRecAllocator::sizeClassOf(8192));
+  EXPECT_EQ(5, AuditRecAllocator::sizeClassOf(8193));
+  EXPECT_EQ(5, AuditRecAllocator::sizeClassOf(MAX_AUDIT_MESSAGE_LENGTH));
+  EXPECT_EQ(-1, AuditRecAllocator::sizeClassOf(MAX_AUDIT_MESSAGE_LENGTH + 1));
+
+  auto spa = std::make_shared<AuditRecAllocator>(8, 2);
+
+  const ExampleRec recLong = {1309, "audit(1568215491.636:81166): argc=2 a0=\"ls\" a1=\"" + std::string(1500, 'x') + "\""};
+  audit_reply reply;
+  FILL_REPLY(reply, recLong);
+
+  auto spBuf = spa->alloc(reply.msg, reply.type, reply.len);
+  ASSERT_TRUE(spBuf != nullptr);
+  EXPECT_EQ(2048, spBuf->capacity());
+  EXPECT_EQ(0, strncmp(recLong.msg.c_str(), spBuf->data(), spBuf->size()));
+  const char *data = spBuf->data();
+
+  spa->recycle(spBuf);
+  EXPECT_EQ(1, spa->poolSize());
+  spBuf = spa->alloc(reply.msg, reply.type, reply.len);
+  EXPECT_EQ(data, spBuf->data());
+
+  auto spBuf2 = spa->duplicate(spBuf);
+  ASSERT_TRUE(spBuf2 != nullptr);
+  EXPECT_EQ(spBuf->size(), spBuf2->size());
+
+  // class limit reached, small class unaffected
+
+  EXPECT_TRUE(spa->alloc(reply.msg, reply.type, reply.len) == nullptr);
+  FILL_REPLY(reply, rec1);
+  EXPECT_TRUE(spa->alloc(reply.msg, reply.type, reply.len) != nullptr);
+
+  AuditRecAllocator::Stats stats = spa->getStats(2);
+  EXPECT_EQ(2048, stats.capacity);
+  EXPECT_EQ(2, stats.maxPoolSize);
+  EXPECT_EQ(2, stats.numAllocated);
+  EXPECT_EQ(0, stats.numFree);
+  EXPECT_EQ(1, stats.numReused);
+  EXPECT_EQ(2, stats.numCreated);
+  EXPECT_EQ(1, stats.numFailed);
+  EXPECT_EQ(1, spa->getStats(0).numCreated);
+
+  spa->recycle(spBuf);
+  spa->recycle(spBuf2);
+  EXPECT_EQ(2, spa->getStats(2).numFree);
+}
+
+TEST_F(AuditRecAllocatorTests, group_arena) {
+  AuditRecArena arena;
+  audit_reply reply;
+  FILL_REPLY(reply, rec1);
+
+  AuditRecordBuf *first = arena.append((const char *)&reply.msg, reply.type, reply.len, 28);
+  AuditRecordBuf *second = arena.append((const char *)&reply.msg, reply.type, reply.len, 28);
+  EXPECT_EQ(2, arena.records.size());
+  EXPECT_EQ(1, arena.numChunks());
+  EXPECT_EQ(reply.len - 28, first->size());
+  EXPECT_EQ(0, strncmp(rec1.msg.c_str() + 28, first->data(false), first->size()));
+  EXPECT_EQ(0, first->data(false)[first->size()]);
+  EXPECT_EQ(1300, second->getType());
+  EXPECT_LT(first->data(false), second->data(false));
+  EXPECT_LT(second->data(false), first->data(false) + AuditRecArena::CHUNK_SIZE);
+
+  // large record gets a chunk of its own, dropped on reset
+
+  const ExampleRec recLong = {1309, "audit(1568215491.636:81166): argc=1 a0=\"" + std::string(8800, 'x') + "\""};
+  FILL_REPLY(reply, recLong);
+  AuditRecordBuf *big = arena.append((const char *)&reply.msg, reply.type, reply.len, 29);
+  EXPECT_EQ(recLong.msg.size() - 29, big->size());
+  EXPECT_EQ(2, arena.numChunks());
+
+  arena.reset();
+  EXPECT_EQ(0, arena.records.size());
+  EXPECT_EQ(1, arena.numChunks());
+
+  // arenas of released groups are reused
+
+  auto spa = std::make_shared<AuditRecAllocator>(2);
+  SPAuditRecArena spArena = spa->allocArena();
+  AuditRecArena *pArena = spArena.get();
+  SPAuditRecArena spArena2 = spa->allocArena();
+  EXPECT_TRUE(spa->allocArena() == nullptr);
+  spa->recycleArena(spArena);
+  EXPECT_TRUE(spArena == nullptr);
+  EXPECT_EQ(1, spa->arenaPoolSize());
+  spArena = spa->allocArena();
+  EXPECT_EQ(pArena, spArena.get());
+
+  // still referenced, left to the holder
+
+  SPAuditRecArena holder = spArena2;
+  spa->recycleArena(spArena2);
+  EXPECT_EQ(0, spa->arenaPoolSize());
+  EXPECT_TRUE(spArena2 == nullptr);
+  EXPECT_EQ(1, holder.use_count());
+}
+
+TEST_F(AuditRecAllocatorTests, record_ref) {
+  auto spa = std::make_shared<AuditRecAllocator>(0);
+  audit_reply reply;
+  FILL_REPLY(reply, rec1);
+
+  AuditRecordRef ref = spa->allocRecord(reply.msg, reply.type, reply.len, 28);
+  ASSERT_TRUE(ref != nullptr);
+  EXPECT_EQ(1, ref.useCount());
+  EXPECT_EQ(1300, ref->getType());
+  EXPECT_EQ(0, strncmp(rec1.msg.c_str() + 28, ref->data(), ref->size()));
+
+  AuditRecordRef copy = ref;
+  EXPECT_EQ(2, ref.useCount());
+  AuditRecordRef moved = std::move(copy);
+  EXPECT_TRUE(copy == nullptr);
+  EXPECT_EQ(2, moved.useCount());
+
+  // still referenced, not pooled
+
+  spa->recycle(moved);
+  EXPECT_TRUE(moved == nullptr);
+  EXPECT_EQ(1, ref.useCount());
+  EXPECT_EQ(0, spa->poolSize());
+
+  AuditRecordBuf *p = ref.get();
+  spa->recycle(ref);
+  EXPECT_EQ(1, spa->poolSize());
+
+  // copies any AuditRecBuf
+
+  auto spCustom = std::make_shared<AuditRecordBuf>(512, -1);
+  memcpy(spCustom->data(true), &reply.msg, reply.len + sizeof(nlmsghdr));
+  spCustom->len_ = reply.len;
+  spCustom->type_ = reply.type;
+  ref = spa->duplicateRecord(*spCustom);
+  EXPECT_EQ(p, ref.get());
+  EXPECT_EQ(reply.len, ref->size());
+  EXPECT_EQ(0, strncmp(rec1.msg.c_str(), ref->data(), ref->size()));
+
+  // shared_ptr shim only pools its own buffers
+
+  SPAuditRecBuf spBuf = spa->duplicate(spCustom);
+  spa->recycle(SPAuditRecBuf(spCustom));
+  EXPECT_EQ(0, spa->poolSize());
+  spa->recycle(spBuf);
+  EXPECT_EQ(1, spa->poolSize());
+}
@@ -26,20 +26,25 @@ extern std::vector<ExampleRec> ex1_records;
 const ExampleRec rec1 = {1300, "audit(1566400380.354:266): arch=c000003e syscall=42 success=yes exit=0 a0=4 a1=7fdf339232a0 a2=6e a3=ffffffb4 items=1 ppid=115255 pid=97970 auid=4294967295 uid=0 gid=0 euid=0 suid=0 fsuid=0 egid=0 sgid=0 fsgid=0 tty=(none) ses=4294967295 comm=\"sshd\" exe=\"/usr/sbin/sshd\" key=(null)"};
 const ExampleRec recArgs1 = {1309, "audit(1568215491.636:81166): argc=20 a0=\"/usr/lib/firefox/firefox\" a1=\"-contentproc\" a2=\"-childID\" a3=\"3\" a4=\"-isForBrowser\" a5=\"-prefsLen\" a6=\"7059\" a7=\"-prefMapSize\" a8=\"182813\" a9=\"-parentBuildID\" a10=\"20190718161435\" a11=\"-greomni\" a12=\"/usr/lib/firefox/omni.ja\" a13=\"-appomni\" a14=2F746D702F746865206C73 a15=\"-appdir\" a16=\"/usr/lib/firefox/browser\" a17=\"69789\" a18=\"true\" a19=\"tab\""};
 
-class AuditRecParseTests : public ::testing::Test {
+// each test runs against both the vectorized and the scalar tokenizer
+class AuditRecParseTests : public ::testing::TestWithParam<bool> {
 protected:
   virtual void SetUp() override {
     listener_ = std::make_shared<MyAuditListener>();
+    tokenizer_ = AuditRecTokenizer(GetParam());
+    parsers_ = AuditRecParsersNew({}, tokenizer_);
   }
   virtual void TearDown() override {
     listener_->cleanup();
   }
   std::shared_ptr<MyAuditListener> listener_;
+  AuditRecTokenizer tokenizer_;
+  SPAuditRecParsers parsers_;
 };
 
-TEST_F(AuditRecParseTests, collect1) {
+TEST_P(AuditRecParseTests, collect1) {
 
-  auto spCollector = AuditCollectorNew(listener_);
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
 
   audit_reply reply;
   FILL_REPLY(reply, rec1);
@@ -55,6 +60,8 @@ TEST_F(AuditRecParseTests, collect1) {
   ASSERT_EQ(1,spGroup->getNumMessages());
   EXPECT_EQ(1300, spGroup->getType());
   EXPECT_EQ("266", spGroup->getSerial());
+  EXPECT_EQ(266, spGroup->getSerialNumber());
+  EXPECT_EQ(266, spGroup->getHeader().serial);
   EXPECT_EQ(1566400380, spGroup->getTimeSeconds());
   EXPECT_EQ(354, spGroup->getTimeMs());
 
@@ -65,9 +72,9 @@ TEST_F(AuditRecParseTests, collect1) {
   EXPECT_EQ(1300, spRec->getType());
 }
 
-TEST_F(AuditRecParseTests, get_field) {
+TEST_P(AuditRecParseTests, get_field) {
 
-  auto spCollector = AuditCollectorNew(listener_);
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
 
   audit_reply reply;
   FILL_REPLY(reply, rec1);
@@ -87,9 +94,9 @@ TEST_F(AuditRecParseTests, get_field) {
   ASSERT_EQ("97970",pidstr);
 }
 
-TEST_F(AuditRecParseTests, multi_groups) {
+TEST_P(AuditRecParseTests, multi_groups) {
 
-  auto spCollector = AuditCollectorNew(listener_);
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
 
   audit_reply reply;
 
@@ -120,9 +127,9 @@ TEST_F(AuditRecParseTests, multi_groups) {
   ASSERT_EQ("/usr/sbin/NetworkManager", value);
 }
 
-TEST_F(AuditRecParseTests, cmdline) {
+TEST_P(AuditRecParseTests, cmdline) {
 
-  auto spCollector = AuditCollectorNew(listener_);
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
 
   audit_reply reply;
   FILL_REPLY(reply, recArgs1);
@@ -142,9 +149,9 @@ TEST_F(AuditRecParseTests, cmdline) {
   EXPECT_EQ("/usr/lib/firefox/firefox -contentproc -childID 3 -isForBrowser -prefsLen 7059 -prefMapSize 182813 -parentBuildID 20190718161435 -greomni /usr/lib/firefox/omni.ja -appomni \"/tmp/the ls\" -appdir /usr/lib/firefox/browser 69789 true tab", cmdline);
 }
 
-TEST_F(AuditRecParseTests, getPathField) {
+TEST_P(AuditRecParseTests, getPathField) {
 
-  auto spCollector = AuditCollectorNew(listener_);
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
 
   audit_reply reply;
   FILL_REPLY(reply, recArgs1);
@@ -166,3 +173,817 @@ TEST_F(AuditRecParseTests, getPathField) {
   spGroup->getPathField("a0",tmp,"X",1309);
   EXPECT_EQ("/usr/lib/firefox/firefox",tmp);
 }
+
+TEST_P(AuditRecParseTests, getPathField_not_hex) {
+
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
+
+  const ExampleRec recPath = {1302, "audit(1568215491.636:81167): item=0 name=(null) inode=1177 dev=fd:00 mode=0100755 ouid=0 ogid=0 rdev=00:00 nametype=NORMAL"};
+
+  audit_reply reply;
+  FILL_REPLY(reply, recPath);
+
+  spCollector->onAuditRecord(reply);
+
+  spCollector->flush();
+
+  ASSERT_EQ(1, listener_->vec.size());
+
+  auto spGroup = listener_->vec[0];
+
+  std::string tmp;
+  EXPECT_TRUE(spGroup->getPathField("name",tmp,"X",1302));
+  EXPECT_EQ("(null)",tmp);
+}
+
+TEST_P(AuditRecParseTests, field_views) {
+
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
+
+  audit_reply reply;
+  FILL_REPLY(reply, recArgs1);
+  spCollector->onAuditRecord(reply);
+  spCollector->flush();
+
+  ASSERT_EQ(1, listener_->vec.size());
+  auto spGroup = listener_->vec[0];
+
+  AuditFieldView view;
+  EXPECT_TRUE(spGroup->getFieldView("a0", view, 1309));
+  EXPECT_TRUE(view.isQuoted);
+  EXPECT_EQ("/usr/lib/firefox/firefox", std::string(view.data, view.len));
+
+  EXPECT_TRUE(spGroup->getFieldView("a14", view, 1309));
+  EXPECT_FALSE(view.isQuoted);
+  EXPECT_EQ("2F746D702F746865206C73", std::string(view.data, view.len));
+
+  EXPECT_FALSE(spGroup->getFieldView("nope", view));
+  EXPECT_EQ(0, view.len);
+
+  char buf[64];
+  size_t len = 0;
+  EXPECT_TRUE(spGroup->getPathField("a14", buf, sizeof(buf), len, 1309));
+  EXPECT_EQ("/tmp/the ls", std::string(buf, len));
+
+  EXPECT_TRUE(spGroup->getPathField("a0", buf, sizeof(buf), len, 1309));
+  EXPECT_EQ("/usr/lib/firefox/firefox", std::string(buf, len));
+
+  // too small, reports needed length
+
+  EXPECT_TRUE(spGroup->getPathField("a0", buf, 4, len, 1309));
+  EXPECT_EQ(24, len);
+
+  EXPECT_FALSE(spGroup->getPathField("nope", buf, sizeof(buf), len));
+  EXPECT_EQ(0, len);
+}
+
+TEST_P(AuditRecParseTests, decoded_path_cache) {
+
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
+
+  audit_reply reply;
+  FILL_REPLY(reply, recArgs1);
+  spCollector->onAuditRecord(reply);
+  spCollector->flush();
+
+  ASSERT_EQ(1, listener_->vec.size());
+  auto spGroup = listener_->vec[0];
+
+  AuditFieldView first, second, raw;
+  EXPECT_TRUE(spGroup->getPathFieldView("a14", first, 1309));
+  EXPECT_EQ("/tmp/the ls", std::string(first.data, first.len));
+  EXPECT_TRUE(spGroup->getPathFieldView("a14", second, 1309));
+  EXPECT_EQ(first.data, second.data);
+
+  std::string value;
+  EXPECT_TRUE(spGroup->getPathField("a14", value, "X", 1309));
+  EXPECT_EQ("/tmp/the ls", value);
+
+  // quoted values are not copied
+
+  EXPECT_TRUE(spGroup->getPathFieldView("a0", first, 1309));
+  EXPECT_TRUE(spGroup->getFieldView("a0", raw, 1309));
+  EXPECT_EQ(raw.data, first.data);
+  EXPECT_EQ("/usr/lib/firefox/firefox", std::string(first.data, first.len));
+
+  EXPECT_FALSE(spGroup->getPathFieldView("nope", first));
+  EXPECT_EQ(0, first.len);
+  spGroup->release();
+}
+
+TEST_P(AuditRecParseTests, scratch_arena) {
+  AuditScratchArena arena;
+  EXPECT_EQ(0, arena.numChunks());
+
+  char *a = arena.alloc(10);
+  char *b = arena.alloc(20);
+  EXPECT_EQ(a + 10, b);
+  EXPECT_EQ(1, arena.numChunks());
+
+  char *big = arena.alloc(AuditScratchArena::CHUNK_SIZE * 2);
+  memset(big, 'x', AuditScratchArena::CHUNK_SIZE * 2);
+  EXPECT_EQ(2, arena.numChunks());
+  arena.alloc(1);
+  EXPECT_EQ(3, arena.numChunks());
+
+  arena.reset();
+  EXPECT_EQ(0, arena.numChunks());
+}
+
+TEST_P(AuditRecParseTests, value_encoding) {
+  const std::string body = "a0=3 a1=7ffd0a10 comm=\"ls\" exe=2F746D702F6C73 tty=(none) key=(null) res=? x=ABC";
+  AuditRecFieldIndex fields;
+  EXPECT_FALSE(tokenizer_.parseFields(body.data(), (int)body.size(), fields));
+  EXPECT_EQ(VALUE_PLAIN, fields.find(FID_A0)->encoding);
+  EXPECT_EQ(VALUE_HEX, fields.find(FID_A1)->encoding);
+  EXPECT_EQ(VALUE_QUOTED, fields.find(FID_COMM)->encoding);
+  EXPECT_EQ(VALUE_HEX, fields.find(FID_EXE)->encoding);
+  EXPECT_EQ(VALUE_LITERAL, fields.find(FID_TTY)->encoding);
+  EXPECT_EQ(VALUE_LITERAL, fields.find(FID_KEY)->encoding);
+  EXPECT_EQ(VALUE_LITERAL, fields.find(FID_RES)->encoding);
+  EXPECT_EQ(VALUE_PLAIN, fields.find("x")->encoding);
+}
+
+TEST_P(AuditRecParseTests, decoded_fields) {
+  const ExampleRec recSyscall = {1300, "audit(1568215491.636:81166): arch=c000003e syscall=59 success=yes exit=0 a0=1234 a1=7ffd0a10 a2=55 a3=0 items=2 ppid=1 pid=4012 auid=0 uid=0 gid=0 euid=0 suid=0 fsuid=0 egid=0 sgid=0 fsgid=0 tty=(none) ses=12 comm=74686520 exe=\"/usr/bin/ls\" key=(null)"};
+
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
+  audit_reply reply;
+  FILL_REPLY(reply, recSyscall);
+  spCollector->onAuditRecord(reply);
+  FILL_REPLY(reply, recArgs1);
+  spCollector->onAuditRecord(reply);
+  spCollector->flush();
+
+  ASSERT_EQ(1, listener_->vec.size());
+  auto spGroup = listener_->vec[0];
+
+  std::string value;
+  EXPECT_TRUE(spGroup->getDecodedField("comm", value, "X"));
+  EXPECT_EQ("the ", value);
+  EXPECT_TRUE(spGroup->getDecodedField(FID_EXE, value, "X"));
+  EXPECT_EQ("/usr/bin/ls", value);
+  EXPECT_TRUE(spGroup->getDecodedField("key", value, "X"));
+  EXPECT_EQ("(null)", value);
+
+  // numbers that look like hex
+
+  EXPECT_TRUE(spGroup->getDecodedField("pid", value, "X"));
+  EXPECT_EQ("4012", value);
+  EXPECT_TRUE(spGroup->getDecodedField(FID_A0, value, "X", 1300));
+  EXPECT_EQ("1234", value);
+  EXPECT_TRUE(spGroup->getDecodedField("a1", value, "X", 1300));
+  EXPECT_EQ("7ffd0a10", value);
+
+  // execve args
+
+  EXPECT_TRUE(spGroup->getDecodedField("a14", value, "X"));
+  EXPECT_EQ("/tmp/the ls", value);
+  EXPECT_TRUE(spGroup->getDecodedField(FID_A0, value, "X", 1309));
+  EXPECT_EQ("/usr/lib/firefox/firefox", value);
+
+  AuditFieldView view;
+  EXPECT_TRUE(spGroup->getDecodedFieldView("a14", view, 1309));
+  EXPECT_EQ(VALUE_HEX, view.encoding);
+  EXPECT_EQ("/tmp/the ls", std::string(view.data, view.len));
+  EXPECT_FALSE(spGroup->getDecodedFieldView("nope", view));
+
+  AuditFieldSpec specs[] = {
+    {1300, FID_COMM, nullptr, 0, AuditFieldSpec::DECODED},
+    {1300, FID_PID, nullptr, 1, AuditFieldSpec::DECODED},
+    {1309, FID_UNKNOWN, "a14", 2, AuditFieldSpec::DECODED}
+  };
+  AuditFieldValue row[3];
+  EXPECT_EQ(0, spGroup->extractFields(specs, 3, row));
+  EXPECT_EQ("the ", row[0].str);
+  EXPECT_EQ("4012", row[1].str);
+  EXPECT_EQ("/tmp/the ls", row[2].str);
+}
+
+TEST_P(AuditRecParseTests, release_arena) {
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
+  audit_reply reply;
+  for (int i = 0; i < 6; i++) {
+    FILL_REPLY(reply, ex1_records[i]);
+    spCollector->onAuditRecord(reply);
+  }
+  spCollector->flush();
+  ASSERT_LE(2, listener_->vec.size());
+
+  auto spGroup = listener_->vec[0];
+  ASSERT_LE(2, spGroup->getNumMessages());
+  SPAuditRecBuf spMsg = spGroup->getMessage(0);
+  std::string text(spMsg->data(), spMsg->size());
+  EXPECT_TRUE(spGroup->getMessage((int)spGroup->getNumMessages()) == nullptr);
+
+  // records stay readable through a held message
+
+  spGroup->release();
+  EXPECT_EQ(0, spGroup->getNumMessages());
+  EXPECT_EQ(text, std::string(spMsg->data(), spMsg->size()));
+
+  std::string value;
+  EXPECT_FALSE(spGroup->getField("pid", value, "X"));
+}
+
+TEST_P(AuditRecParseTests, numeric_fields) {
+
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
+
+  const ExampleRec recFail = {1300, "audit(1566400380.354:267): arch=c000003e syscall=2 success=no exit=-2 a0=7ffd4e8c1f60 a1=0 a2=1b6 a3=0 items=1 ppid=115255 pid=97970 auid=4294967295 uid=0 gid=0 euid=0 suid=0 fsuid=0 egid=0 sgid=0 fsgid=0 tty=(none) ses=4294967295 comm=\"cat\" exe=\"/usr/bin/cat\" key=(null) items2=99999999999999999999"};
+
+  audit_reply reply;
+  FILL_REPLY(reply, recFail);
+
+  spCollector->onAuditRecord(reply);
+
+  spCollector->flush();
+
+  ASSERT_EQ(1, listener_->vec.size());
+
+  auto spGroup = listener_->vec[0];
+
+  int64_t ival = 0;
+  uint64_t uval = 0;
+  EXPECT_EQ(AuditParseUtils::NUM_OK, spGroup->getFieldInt("pid", ival, -1, 1300));
+  EXPECT_EQ(97970, ival);
+  EXPECT_EQ(AuditParseUtils::NUM_OK, spGroup->getFieldInt("exit", ival, 0));
+  EXPECT_EQ(-2, ival);
+  EXPECT_EQ(AuditParseUtils::NUM_OK, spGroup->getFieldUInt("auid", uval, 0));
+  EXPECT_EQ(4294967295ULL, uval);
+  EXPECT_EQ(AuditParseUtils::NUM_OK, spGroup->getFieldHex("arch", uval, 0));
+  EXPECT_EQ(0xc000003eULL, uval);
+  EXPECT_EQ(AuditParseUtils::NUM_OK, spGroup->getFieldHex("a0", uval, 0));
+  EXPECT_EQ(0x7ffd4e8c1f60ULL, uval);
+
+  EXPECT_EQ(AuditParseUtils::NUM_MALFORMED, spGroup->getFieldInt("tty", ival, -1));
+  EXPECT_EQ(-1, ival);
+  EXPECT_EQ(AuditParseUtils::NUM_MALFORMED, spGroup->getFieldUInt("exit", uval, 7));
+  EXPECT_EQ(7, uval);
+  EXPECT_EQ(AuditParseUtils::NUM_OVERFLOW, spGroup->getFieldUInt("items2", uval, 0));
+  EXPECT_EQ(AuditParseUtils::NUM_NOT_FOUND, spGroup->getFieldInt("nosuch", ival, 5));
+  EXPECT_EQ(5, ival);
+  EXPECT_EQ(AuditParseUtils::NUM_NOT_FOUND, spGroup->getFieldInt("pid", ival, 5, 1306));
+}
+
+TEST_P(AuditRecParseTests, nth_field) {
+
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
+
+  const ExampleRec recPath0 = {1302, "audit(1568215491.636:81168): item=0 name=\"/usr/bin/ls\" inode=1177 nametype=NORMAL"};
+  const ExampleRec recPath1 = {1302, "audit(1568215491.636:81168): item=1 name=2F746D702F746865206C73 inode=1178 nametype=CREATE"};
+
+  audit_reply reply;
+  FILL_REPLY(reply, recPath0);
+  spCollector->onAuditRecord(reply);
+  FILL_REPLY(reply, recPath1);
+  spCollector->onAuditRecord(reply);
+
+  spCollector->flush();
+
+  ASSERT_EQ(1, listener_->vec.size());
+
+  auto spGroup = listener_->vec[0];
+
+  ASSERT_EQ(2, spGroup->getNumMessages());
+
+  std::string tmp;
+  EXPECT_TRUE(spGroup->getField("nametype", tmp, "X", 1302, 1));
+  EXPECT_EQ("CREATE", tmp);
+  EXPECT_TRUE(spGroup->getPathField("name", tmp, "X", 1302, 1));
+  EXPECT_EQ("/tmp/the ls", tmp);
+  EXPECT_TRUE(spGroup->getPathField(FID_NAME, tmp, "X", 0, 0));
+  EXPECT_EQ("/usr/bin/ls", tmp);
+  EXPECT_FALSE(spGroup->getField("nametype", tmp, "X", 1302, 2));
+  EXPECT_EQ("X", tmp);
+
+  int64_t ival = 0;
+  EXPECT_EQ(AuditParseUtils::NUM_OK, spGroup->getFieldInt("inode", ival, -1, 0, 1));
+  EXPECT_EQ(1178, ival);
+  EXPECT_EQ(AuditParseUtils::NUM_OK, spGroup->getFieldInt(FID_ITEM, ival, -1, 1302, 1));
+  EXPECT_EQ(1, ival);
+
+  AuditFieldView view;
+  EXPECT_TRUE(spGroup->getDecodedFieldView(FID_NAME, view, 1302, 1));
+  EXPECT_EQ("/tmp/the ls", std::string(view.data, view.len));
+}
+
+TEST_P(AuditRecParseTests, bad_preamble) {
+
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
+
+  const ExampleRec badSerial = {1300, "audit(1566400380.354:2x6): arch=c000003e syscall=42"};
+  const ExampleRec badTime = {1300, "audit(15664003a0.354:266): arch=c000003e syscall=42"};
+  const ExampleRec noSerial = {1300, "audit(1566400380.354:): arch=c000003e syscall=42"};
+
+  audit_reply reply;
+  FILL_REPLY(reply, badSerial);
+  EXPECT_TRUE(spCollector->onAuditRecord(reply));
+  FILL_REPLY(reply, badTime);
+  EXPECT_TRUE(spCollector->onAuditRecord(reply));
+  FILL_REPLY(reply, noSerial);
+  EXPECT_TRUE(spCollector->onAuditRecord(reply));
+
+  FILL_REPLY(reply, ex1_records[0]);
+  EXPECT_FALSE(spCollector->onAuditRecord(reply));
+  spCollector->flush();
+
+  ASSERT_EQ(1, listener_->vec.size());
+  EXPECT_EQ(252, listener_->vec[0]->getSerialNumber());
+  EXPECT_EQ(1566400374, listener_->vec[0]->getTimeSeconds());
+  EXPECT_EQ(482, listener_->vec[0]->getTimeMs());
+}
+
+static void expectSameFields(const std::string &body) {
+  AuditRecFieldIndex scalarFields, vectorFields;
+  bool scalarErr = DefaultAuditRecFieldParser::parseFields(body.data(), (int)body.size(), scalarFields);
+  bool vectorErr = VectorAuditRecFieldParser::parseFields(body.data(), (int)body.size(), vectorFields);
+  EXPECT_EQ(scalarErr, vectorErr) << body;
+  ASSERT_EQ(scalarFields.size(), vectorFields.size()) << body;
+  for (size_t i = 0; i < scalarFields.size(); i++) {
+    auto &it = scalarFields.at(i);
+    auto fit = vectorFields.find(it.key, it.keylen, it.hash);
+    ASSERT_TRUE(fit != nullptr) << std::string(it.key, it.keylen) << " in " << body;
+    EXPECT_EQ(it.value.start, fit->start) << body;
+    EXPECT_EQ(it.value.len, fit->len) << body;
+    EXPECT_EQ(it.value.isQuoted, fit->isQuoted) << body;
+    EXPECT_EQ(it.value.encoding, fit->encoding) << body;
+  }
+}
+
+static std::string bodyOf(const std::string &msg) {
+  size_t pos = msg.find("):");
+  if (pos == std::string::npos) {
+    return msg;
+  }
+  pos += 2;
+  if (pos < msg.size() && msg[pos] == ' ') {
+    pos++;
+  }
+  return msg.substr(pos);
+}
+
+TEST_P(AuditRecParseTests, tokenizer_equivalence) {
+  expectSameFields(bodyOf(rec1.msg));
+  expectSameFields(bodyOf(recArgs1.msg));
+  for (auto &rec : ex1_records) {
+    expectSameFields(bodyOf(rec.msg));
+  }
+
+  expectSameFields("");
+  expectSameFields("a");
+  expectSameFields("a=");
+  expectSameFields("a=b=c");
+  expectSameFields("a=\"unterminated value");
+  expectSameFields("a='x' b=\"y z\" c");
+  expectSameFields("no key here=v  x==y");
+  expectSameFields(std::string(63, 'k') + "=\"" + std::string(70, 'v') + "\" z='" + std::string(64, ' ') + "'");
+  expectSameFields("a=" + std::string(130, 'F') + " b=" + std::string(127, '0') + "x c=" + std::string(61, 'e'));
+
+  // random bodies over the delimiter alphabet, crossing block boundaries
+  const char alphabet[] = "abx= \"'";
+  uint32_t seed = 12345;
+  for (int i = 0; i < 2000; i++) {
+    std::string body;
+    size_t len = i % 200;
+    for (size_t j = 0; j < len; j++) {
+      seed = seed * 1103515245 + 12345;
+      body += alphabet[(seed >> 16) % 7];
+    }
+    expectSameFields(body);
+  }
+}
+
+TEST_P(AuditRecParseTests, field_index) {
+  // many fields, forcing the spill path, and a repeated key
+  std::string body;
+  for (int i = 0; i < 50; i++) {
+    body += "k" + std::to_string(i) + "=" + std::to_string(i * 10) + " ";
+  }
+  body += "k3=last";
+
+  AuditRecFieldIndex index;
+  ASSERT_FALSE(tokenizer_.parseFields(body.data(), (int)body.size(), index));
+  EXPECT_EQ(50, index.size());
+
+  for (int i = 0; i < 50; i++) {
+    auto entry = index.find("k" + std::to_string(i));
+    ASSERT_TRUE(entry != nullptr);
+    std::string expected = (i == 3) ? "last" : std::to_string(i * 10);
+    EXPECT_EQ(expected, body.substr(entry->start, entry->len));
+  }
+  EXPECT_EQ(nullptr, index.find("k50"));
+  EXPECT_EQ(nullptr, index.find("k"));
+
+  index.clear();
+  EXPECT_TRUE(index.empty());
+  EXPECT_EQ(nullptr, index.find("k1"));
+
+  // hundreds of spilled keys, repeated spilled keys and known IDs
+  body.clear();
+  for (int i = 0; i < 500; i++) {
+    body += "a" + std::to_string(i) + "=" + std::to_string(i) + " ";
+  }
+  body += "pid=1 a400=x a40=y pid=2 uid=3";
+  ASSERT_FALSE(tokenizer_.parseFields(body.data(), (int)body.size(), index));
+  EXPECT_EQ(502, index.size());
+  for (int i = 0; i < 500; i++) {
+    auto entry = index.find("a" + std::to_string(i));
+    ASSERT_TRUE(entry != nullptr);
+    std::string expected = (i == 400) ? "x" : (i == 40) ? "y" : std::to_string(i);
+    EXPECT_EQ(expected, body.substr(entry->start, entry->len));
+  }
+  auto pid = index.find(FID_PID);
+  ASSERT_TRUE(pid != nullptr);
+  EXPECT_EQ("2", body.substr(pid->start, pid->len));
+  ASSERT_TRUE(index.find("uid") != nullptr);
+  EXPECT_EQ(nullptr, index.find("a500"));
+  EXPECT_EQ(nullptr, index.find(FID_GID));
+
+  index.clear();
+  EXPECT_EQ(nullptr, index.find("a100"));
+  EXPECT_EQ(nullptr, index.find(FID_PID));
+}
+
+TEST_P(AuditRecParseTests, field_ids) {
+  EXPECT_FALSE(AuditFieldIds::slotsCollide(AuditFieldIds::HASH_MULT));
+  EXPECT_TRUE(AuditFieldIds::slotsCollide(1));
+  for (int id = 1; id < FID_COUNT; id++) {
+    const char *name = AuditFieldIds::name((AuditFieldId)id);
+    EXPECT_EQ(id, AuditFieldIds::lookup(name, strlen(name))) << name;
+  }
+  EXPECT_EQ(FID_PID, AuditFieldIds::lookup("pid", 3));
+  EXPECT_EQ(FID_UNKNOWN, AuditFieldIds::lookup("pi", 2));
+  EXPECT_EQ(FID_UNKNOWN, AuditFieldIds::lookup("pidx", 4));
+  EXPECT_EQ(FID_UNKNOWN, AuditFieldIds::lookup("_avc_status", 11));
+  EXPECT_EQ(FID_UNKNOWN, AuditFieldIds::lookup("", 0));
+  EXPECT_STREQ("", AuditFieldIds::name(FID_UNKNOWN));
+  EXPECT_STREQ("", AuditFieldIds::name(FID_COUNT));
+
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
+
+  audit_reply reply;
+  FILL_REPLY(reply, rec1);
+  spCollector->onAuditRecord(reply);
+  spCollector->flush();
+
+  ASSERT_EQ(1, listener_->vec.size());
+  auto spGroup = listener_->vec[0];
+
+  std::string value;
+  EXPECT_TRUE(spGroup->getField(FID_PID, value, "X"));
+  EXPECT_EQ("97970", value);
+  EXPECT_TRUE(spGroup->getPathField(FID_EXE, value, "X", 1300));
+  EXPECT_EQ("/usr/sbin/sshd", value);
+  EXPECT_FALSE(spGroup->getField(FID_CWD, value, "X"));
+  EXPECT_EQ("X", value);
+
+  int64_t ival;
+  EXPECT_EQ(AuditParseUtils::NUM_OK, spGroup->getFieldInt(FID_EXIT, ival, -1));
+  EXPECT_EQ(0, ival);
+  uint64_t uval;
+  EXPECT_EQ(AuditParseUtils::NUM_OK, spGroup->getFieldUInt(FID_AUID, uval, 0));
+  EXPECT_EQ(4294967295ULL, uval);
+  EXPECT_EQ(AuditParseUtils::NUM_OK, spGroup->getFieldHex(FID_ARCH, uval, 0));
+  EXPECT_EQ(0xc000003eULL, uval);
+  EXPECT_EQ(AuditParseUtils::NUM_NOT_FOUND, spGroup->getFieldHex(FID_ARCH, uval, 7, 1309));
+  EXPECT_EQ(7, uval);
+}
+
+TEST_P(AuditRecParseTests, projection) {
+  std::string body = bodyOf(rec1.msg);
+
+  AuditRecFieldIndex index;
+  AuditFieldSet fields = {FID_SYSCALL, FID_PID, FID_UID};
+  EXPECT_FALSE(parsers_->parseProjected(body.data(), (int)body.size(), fields, index));
+  EXPECT_TRUE(index.isPartial());
+  ASSERT_EQ(3, index.size());
+  ASSERT_TRUE(index.find(FID_UID) != nullptr);
+  EXPECT_EQ("0", body.substr(index.find(FID_UID)->start, index.find(FID_UID)->len));
+  EXPECT_EQ(nullptr, index.find(FID_EXE));
+
+  // a repeated projected key keeps its last value, as in a full parse
+  std::string repeated = "pid=1 uid=2 pid=3 syscall=4 pid=5";
+  index.clear();
+  EXPECT_FALSE(parsers_->parseProjected(repeated.data(), (int)repeated.size(), fields, index));
+  ASSERT_TRUE(index.find(FID_PID) != nullptr);
+  EXPECT_EQ("5", repeated.substr(index.find(FID_PID)->start, index.find(FID_PID)->len));
+
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
+  spCollector->setProjection(1300, {FID_PID, FID_COMM, FID_CWD});
+
+  audit_reply reply;
+  FILL_REPLY(reply, rec1);
+  spCollector->onAuditRecord(reply);
+  spCollector->clearProjection(1300);
+  spCollector->onAuditRecord(reply);  // same serial, same group
+  spCollector->flush();
+
+  ASSERT_EQ(1, listener_->vec.size());
+  auto spGroup = listener_->vec[0];
+
+  std::string value;
+  EXPECT_TRUE(spGroup->getField(FID_PID, value, "X", 1300));
+  EXPECT_EQ("97970", value);
+  EXPECT_TRUE(spGroup->getField("comm", value, "X", 1300));
+  EXPECT_EQ("sshd", value);
+  EXPECT_FALSE(spGroup->getField(FID_CWD, value, "X", 1300));
+
+  // not projected, falls back to full parse
+  EXPECT_TRUE(spGroup->getField("exe", value, "X", 1300));
+  EXPECT_EQ("/usr/sbin/sshd", value);
+  EXPECT_TRUE(spGroup->getField("key", value, "X", 1300));
+  EXPECT_EQ("(null)", value);
+}
+
+TEST_P(AuditRecParseTests, extract_fields) {
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
+
+  audit_reply reply;
+  for (int i=0; i < 3; i++) {
+    FILL_REPLY(reply, ex1_records[i]);
+    spCollector->onAuditRecord(reply);
+  }
+  spCollector->flush();
+
+  ASSERT_EQ(1, listener_->vec.size());
+  auto spGroup = listener_->vec[0];
+
+  enum { PID, EXE, SADDR, TITLE, CWD, TTY, NSLOTS };
+  const AuditFieldSpec specs[] = {
+    {1300, FID_PID, nullptr, PID, AuditFieldSpec::INT},
+    {1300, FID_EXE, nullptr, EXE, AuditFieldSpec::RAW},
+    {0, FID_UNKNOWN, "saddr", SADDR, AuditFieldSpec::RAW},
+    {1327, FID_PROCTITLE, nullptr, TITLE, AuditFieldSpec::PATH},
+    {1307, FID_CWD, nullptr, CWD, AuditFieldSpec::PATH},
+    {1300, FID_CWD, nullptr, CWD, AuditFieldSpec::PATH},
+    {1300, FID_TTY, nullptr, TTY, AuditFieldSpec::INT},
+  };
+  AuditFieldValue row[NSLOTS];
+
+  EXPECT_EQ(1, spGroup->extractFields(specs, sizeof(specs) / sizeof(specs[0]), row));
+
+  EXPECT_EQ(AuditParseUtils::NUM_OK, row[PID].status);
+  EXPECT_EQ(672, row[PID].num);
+  EXPECT_EQ(AuditParseUtils::NUM_OK, row[EXE].status);
+  EXPECT_EQ("/usr/sbin/NetworkManager", row[EXE].str);
+  EXPECT_EQ("020000357F000035F850DDC51F560000", row[SADDR].str);
+  EXPECT_EQ(std::string("/usr/sbin/NetworkManager\0--no-daemon", 36), row[TITLE].str);
+  EXPECT_EQ(AuditParseUtils::NUM_NOT_FOUND, row[CWD].status);
+  EXPECT_EQ(AuditParseUtils::NUM_MALFORMED, row[TTY].status);  // (none)
+}
+
+TEST_P(AuditRecParseTests, extract_fields_fallback_order) {
+  // the primary spec's record comes after the fallback's record
+  const ExampleRec execve = {1309, "audit(1566400380.354:266): argc=2 a0=\"ls\" a1=\"-l\""};
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
+
+  audit_reply reply;
+  FILL_REPLY(reply, rec1);
+  spCollector->onAuditRecord(reply);
+  FILL_REPLY(reply, execve);
+  spCollector->onAuditRecord(reply);
+  spCollector->flush();
+
+  ASSERT_EQ(1, listener_->vec.size());
+  auto spGroup = listener_->vec[0];
+  ASSERT_EQ(2, spGroup->getNumMessages());
+
+  const AuditFieldSpec specs[] = {
+    {1309, FID_A0, nullptr, 0, AuditFieldSpec::RAW},
+    {1300, FID_EXE, nullptr, 0, AuditFieldSpec::RAW},
+    {1309, FID_UNKNOWN, "nope", 1, AuditFieldSpec::RAW},
+    {1300, FID_UNKNOWN, "nope", 1, AuditFieldSpec::RAW},
+    {0, FID_UNKNOWN, "argc", 2, AuditFieldSpec::INT},
+  };
+  AuditFieldValue row[3];
+
+  EXPECT_EQ(1, spGroup->extractFields(specs, sizeof(specs) / sizeof(specs[0]), row));
+  EXPECT_EQ(AuditParseUtils::NUM_OK, row[0].status);
+  EXPECT_EQ("ls", row[0].str);
+  EXPECT_EQ(AuditParseUtils::NUM_NOT_FOUND, row[1].status);
+  EXPECT_EQ(2, row[2].num);
+
+  // without the primary, the fallback fills the slot
+  EXPECT_EQ(0, spGroup->extractFields(specs + 1, 1, row));
+  EXPECT_EQ("/usr/sbin/sshd", row[0].str);
+}
+
+static void expectSameAsSchema(const AuditRecTokenizer &tokenizer, int recType, const std::string &body) {
+  FixedSchemaFieldsParser parser(tokenizer);
+  AuditRecFieldIndex expected, actual;
+  bool expectedErr = DefaultAuditRecFieldParser::parseFields(body.data(), (int)body.size(), expected);
+  bool actualErr = parser.parseFields(recType, body.data(), (int)body.size(), actual);
+  EXPECT_EQ(expectedErr, actualErr) << body;
+  ASSERT_EQ(expected.size(), actual.size()) << body;
+  for (size_t i = 0; i < expected.size(); i++) {
+    auto &it = expected.at(i);
+    auto &other = actual.at(i);
+    EXPECT_EQ(std::string(it.key, it.keylen), std::string(other.key, other.keylen)) << body;
+    EXPECT_EQ(it.id, other.id);
+    EXPECT_EQ(it.hash, other.hash);
+    EXPECT_EQ(it.value.start, other.value.start) << body;
+    EXPECT_EQ(it.value.len, other.value.len) << body;
+    EXPECT_EQ(it.value.isQuoted, other.value.isQuoted) << body;
+    EXPECT_EQ(it.value.encoding, other.value.encodingOf(body.data() + other.value.start)) << body;
+  }
+}
+
+TEST_P(AuditRecParseTests, fixed_schema) {
+  FixedSchemaFieldsParser parser(tokenizer_);
+  for (int recType : {1300, 1302, 1306, 1307, 1320, 1327}) {
+    EXPECT_TRUE(parser.handlesType(recType));
+  }
+  EXPECT_FALSE(parser.handlesType(1309));
+
+  for (auto &rec : ex1_records) {
+    expectSameAsSchema(tokenizer_, rec.rectype, bodyOf(rec.msg));
+  }
+  expectSameAsSchema(tokenizer_, 1300, bodyOf(rec1.msg));
+
+  // out of order, unknown and repeated keys, malformed tails
+  expectSameAsSchema(tokenizer_, 1300, "arch=c000003e syscall=59 success=no exit=-2 a0=1 extra=\"x y\" pid=1 pid=2");
+  expectSameAsSchema(tokenizer_, 1300, "syscall=59 arch=c000003e");
+  expectSameAsSchema(tokenizer_, 1300, "arch=c000003e  syscall=59");
+  expectSameAsSchema(tokenizer_, 1302, "item=1 name=(null) nametype=DELETE cap_fp=0");
+  expectSameAsSchema(tokenizer_, 1307, "cwd=");
+  expectSameAsSchema(tokenizer_, 1307, "cwd=\"/tmp");
+  expectSameAsSchema(tokenizer_, 1307, "cwdx=1");
+  expectSameAsSchema(tokenizer_, 1320, "");
+  expectSameAsSchema(tokenizer_, 1320, "a=b");
+
+  // through a collector
+  auto spCollector = AuditCollectorNew(listener_, 500, AuditRecParsersNew({FixedSchemaFieldsParserNew(tokenizer_)}, tokenizer_));
+  audit_reply reply;
+  FILL_REPLY(reply, rec1);
+  spCollector->onAuditRecord(reply);
+  spCollector->flush();
+  ASSERT_EQ(1, listener_->vec.size());
+  std::string value;
+  EXPECT_TRUE(listener_->vec[0]->getField("exe", value, "X"));
+  EXPECT_EQ("/usr/sbin/sshd", value);
+
+  // classified on first read
+  AuditFieldView view;
+  EXPECT_TRUE(listener_->vec[0]->getFieldView(FID_A1, view));
+  EXPECT_EQ(VALUE_HEX, view.encoding);
+  EXPECT_TRUE(listener_->vec[0]->getFieldView(FID_KEY, view));
+  EXPECT_EQ(VALUE_LITERAL, view.encoding);
+}
+
+TEST_P(AuditRecParseTests, shape_cache) {
+  ShapeCacheFieldsParser parser(1300, 1399, tokenizer_);
+  EXPECT_TRUE(parser.handlesType(1300));
+  EXPECT_FALSE(parser.handlesType(1400));
+
+  size_t numHandled = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    for (auto &rec : ex1_records) {
+      if (!parser.handlesType(rec.rectype)) {
+        continue;
+      }
+      numHandled++;
+      std::string body = bodyOf(rec.msg);
+      AuditRecFieldIndex expected, actual;
+      DefaultAuditRecFieldParser::parseFields(body.data(), (int)body.size(), expected);
+      parser.parseFields(rec.rectype, body.data(), (int)body.size(), actual);
+      ASSERT_EQ(expected.size(), actual.size()) << body;
+      for (size_t i = 0; i < expected.size(); i++) {
+        auto &it = expected.at(i);
+        auto fit = actual.find(it.key, it.keylen, it.hash);
+        ASSERT_TRUE(fit != nullptr) << body;
+        EXPECT_EQ(it.value.start, fit->start);
+        EXPECT_EQ(it.value.len, fit->len);
+      }
+    }
+  }
+  // one miss per record type on the first pass, a full PATH layout
+  // may follow a shorter one
+  EXPECT_LE(parser.getMisses(), 6);
+  EXPECT_EQ(numHandled, parser.getHits() + parser.getMisses());
+
+  // different layout misses, then is learned
+  std::string body = "arch=c000003e syscall=59 extra=1";
+  AuditRecFieldIndex index;
+  uint64_t misses = parser.getMisses();
+  parser.parseFields(1300, body.data(), (int)body.size(), index);
+  EXPECT_EQ(misses + 1, parser.getMisses());
+  ASSERT_TRUE(index.find("extra") != nullptr);
+  index.clear();
+  parser.parseFields(1300, body.data(), (int)body.size(), index);
+  EXPECT_EQ(misses + 1, parser.getMisses());
+  EXPECT_EQ(3, index.size());
+}
+
+TEST_P(AuditRecParseTests, shape_cache_alternating) {
+  ShapeCacheFieldsParser parser(1300, 1399, tokenizer_);
+  const std::string bodies[] = {
+    "arch=c000003e syscall=59 subj=unconfined key=(null)",
+    "arch=c000003e syscall=59 exe=\"/bin/ls\" extra=1",
+    "pid=1 uid=0",
+    "a=1 b=2 c=3",
+    "x=1",
+    "y=2 z=3",
+  };
+
+  // two layouts alternating are both kept
+  for (int i = 0; i < 100; i++) {
+    const std::string &body = bodies[i % 2];
+    AuditRecFieldIndex expected, actual;
+    DefaultAuditRecFieldParser::parseFields(body.data(), (int)body.size(), expected);
+    EXPECT_FALSE(parser.parseFields(1300, body.data(), (int)body.size(), actual));
+    ASSERT_EQ(expected.size(), actual.size()) << body;
+    for (size_t j = 0; j < expected.size(); j++) {
+      auto &it = expected.at(j);
+      auto fit = actual.find(it.key, it.keylen, it.hash);
+      ASSERT_TRUE(fit != nullptr) << body;
+      EXPECT_EQ(it.value.start, fit->start);
+      EXPECT_EQ(it.value.len, fit->len);
+    }
+  }
+  EXPECT_EQ(2, parser.getMisses());
+  EXPECT_EQ(2, parser.getNumLearned());
+
+  // more layouts than slots: the extra ones miss, without relearning
+  for (int i = 0; i < 600; i++) {
+    const std::string &body = bodies[i % 6];
+    AuditRecFieldIndex index;
+    parser.parseFields(1300, body.data(), (int)body.size(), index);
+    ASSERT_TRUE(index.find(body.substr(0, body.find('='))) != nullptr);
+  }
+  EXPECT_EQ(ShapeCacheFieldsParser::LAYOUTS_PER_TYPE, parser.getNumLearned());
+
+  // a new layout that persists replaces one
+  const std::string body = "only=1";
+  for (int i = 0; i < (int)ShapeCacheFieldsParser::REPLACE_AFTER_MISSES + 2; i++) {
+    AuditRecFieldIndex index;
+    parser.parseFields(1300, body.data(), (int)body.size(), index);
+  }
+  EXPECT_EQ(ShapeCacheFieldsParser::LAYOUTS_PER_TYPE + 1, parser.getNumLearned());
+  uint64_t misses = parser.getMisses();
+  AuditRecFieldIndex index;
+  parser.parseFields(1300, body.data(), (int)body.size(), index);
+  EXPECT_EQ(misses, parser.getMisses());
+}
+
+TEST_P(AuditRecParseTests, shape_cache_nested) {
+  // a quoted value that looks like fields, in a type the cache handles
+  const ExampleRec recNested = {1300, "audit(1566400380.354:266): arch=c000003e syscall=42 comm=\"op=x acct=root\" key=(null)"};
+
+  auto spShapes = ShapeCacheFieldsParserNew(1300, 1399, tokenizer_);
+  auto spCollector = AuditCollectorNew(listener_, 500, AuditRecParsersNew({spShapes}, tokenizer_));
+  audit_reply reply;
+  FILL_REPLY(reply, recNested);
+  spCollector->onAuditRecord(reply);
+  spCollector->flush();
+
+  ASSERT_EQ(1, listener_->vec.size());
+  auto spGroup = listener_->vec[0];
+  std::string value;
+  EXPECT_TRUE(spGroup->getField(FID_SYSCALL, value, "X"));
+  EXPECT_EQ(1, spShapes->getNumLearned());
+  uint64_t lookups = spShapes->getHits() + spShapes->getMisses();
+
+  // expanding it goes around the cache
+  std::map<std::string,std::string> subfields;
+  EXPECT_TRUE(spGroup->expandField("comm", 1300, subfields));
+  EXPECT_EQ("root", subfields["acct"]);
+  EXPECT_TRUE(spGroup->getField("comm_op", value, "X"));
+  EXPECT_EQ("x", value);
+  EXPECT_EQ(1, spShapes->getNumLearned());
+  EXPECT_EQ(lookups, spShapes->getHits() + spShapes->getMisses());
+}
+
+TEST_P(AuditRecParseTests, nested_fields) {
+  const ExampleRec recUser = {1100, "audit(1566400378.206:264): pid=97970 uid=0 auid=4294967295 ses=4294967295 msg='op=PAM:authentication acct=\"root\" exe=\"/usr/sbin/sshd\" hostname=127.0.0.1 addr=127.0.0.1 terminal=ssh res=failed'"};
+
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
+  audit_reply reply;
+  FILL_REPLY(reply, recUser);
+  spCollector->onAuditRecord(reply);
+  spCollector->flush();
+
+  ASSERT_EQ(1, listener_->vec.size());
+  auto spGroup = listener_->vec[0];
+
+  std::string value;
+  EXPECT_TRUE(spGroup->getField("msg_acct", value, "X"));
+  EXPECT_EQ("root", value);
+  EXPECT_TRUE(spGroup->getPathField("msg_exe", value, "X", 1100));
+  EXPECT_EQ("/usr/sbin/sshd", value);
+  EXPECT_TRUE(spGroup->getField("msg_res", value, "X"));
+  EXPECT_EQ("failed", value);
+  EXPECT_FALSE(spGroup->getField("msg_nope", value, "X"));
+  EXPECT_FALSE(spGroup->getField("msg_acct", value, "X", 1300));
+  EXPECT_FALSE(spGroup->getField("pid_x", value, "X"));
+
+  std::map<std::string,std::string> subfields;
+  EXPECT_TRUE(spGroup->expandField("msg", 0, subfields));
+  EXPECT_EQ(7, subfields.size());
+  EXPECT_EQ("PAM:authentication", subfields["op"]);
+  EXPECT_EQ("ssh", subfields["terminal"]);
+  EXPECT_FALSE(spGroup->expandField("pid", 0, subfields));
+  EXPECT_FALSE(spGroup->expandField("nope", 0, subfields));
+}
+
+INSTANTIATE_TEST_SUITE_P(Tokenizers, AuditRecParseTests, ::testing::Values(true, false));
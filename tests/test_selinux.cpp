@@ -22,28 +22,27 @@ struct MyAuditListener : public AuditListener {
 
 
 
-class AuditRecSELinuxParseTests : public ::testing::Test {
-public:
-  AuditRecSELinuxParseTests() : ::testing::Test() {
-    auto selParser = SELinuxFieldsParserNew();
-
-    AuditRecParsers::getInstance().addFieldsParser(selParser);
-  }
+// each test runs against both the vectorized and the scalar tokenizer
+class AuditRecSELinuxParseTests : public ::testing::TestWithParam<bool> {
 protected:
   virtual void SetUp() override {
     listener_ = std::make_shared<MyAuditListener>();
+    tokenizer_ = AuditRecTokenizer(GetParam());
+    parsers_ = AuditRecParsersNew({SELinuxFieldsParserNew(tokenizer_)}, tokenizer_);
   }
   virtual void TearDown() override {
     listener_->cleanup();
   }
   std::shared_ptr<MyAuditListener> listener_;
+  AuditRecTokenizer tokenizer_;
+  SPAuditRecParsers parsers_;
 };
 
 //static ExampleRec ex_sel_avc_denied1 = {1400, "audit(1242575005.122:101): avc: denied { rename } for pid=2508 comm="canberra-gtk-pl" ...
 
-TEST_F(AuditRecSELinuxParseTests, avc_denied1) {
+TEST_P(AuditRecSELinuxParseTests, avc_denied1) {
 
-  auto spCollector = AuditCollectorNew(listener_);
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
 
   // avc: denied { rename } for pid=2508 comm="canberra-gtk-pl"
 
@@ -72,9 +71,9 @@ TEST_F(AuditRecSELinuxParseTests, avc_denied1) {
   EXPECT_EQ("canberra-gtk-pl", value);
 }
 
-TEST_F(AuditRecSELinuxParseTests, avc_record_granted) {
+TEST_P(AuditRecSELinuxParseTests, avc_record_granted) {
 
-  auto spCollector = AuditCollectorNew(listener_);
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
 
   audit_reply reply;
   FILL_REPLY(reply, ex_sel_avc_granted1);
@@ -100,9 +99,9 @@ TEST_F(AuditRecSELinuxParseTests, avc_record_granted) {
 }
 
 // static ExampleRec ex_sel_policy1 = {1403,"audit(1336662937.117:394): policy loaded auid=0 ses=2"};
-TEST_F(AuditRecSELinuxParseTests, sel_policy1) {
+TEST_P(AuditRecSELinuxParseTests, sel_policy1) {
 
-  auto spCollector = AuditCollectorNew(listener_);
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
 
   audit_reply reply;
   FILL_REPLY(reply, ex_sel_policy1);
@@ -127,9 +126,13 @@ TEST_F(AuditRecSELinuxParseTests, sel_policy1) {
 
 //static ExampleRec ex_sel_user_avc1 = {1167, "audit(1267534395.930:19): user pid=1169 uid=0 auid=4294967295 ses=4294967295 subj=system_u:unconfined_r:unconfined_t msg='avc: denied { read } for request=SELinux:SELinuxGetClientContext comm=X-setest resid=3c00001 restype=<unknown> scontext=unconfined_u:unconfined_r:x_select_paste_t tcontext=unconfined_u:unconfined_r:unconfined_t tclass=x_resource : exe=\"/usr/bin/Xorg\" sauid=0 hostname=? addr=? terminal=?'"};
 
-TEST_F(AuditRecSELinuxParseTests, sel_user_avc1) {
+// 1167 is not an SELinux type, so it gets the default parser
+TEST_P(AuditRecSELinuxParseTests, sel_user_avc1) {
 
-  auto spCollector = AuditCollectorNew(listener_);
+  SELinuxFieldsParser parser(tokenizer_);
+  EXPECT_FALSE(parser.handlesType(1167));
+
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
 
   audit_reply reply;
   FILL_REPLY(reply, ex_sel_user_avc1);
@@ -145,6 +148,40 @@ TEST_F(AuditRecSELinuxParseTests, sel_user_avc1) {
   ASSERT_EQ(1,spGroup->getNumMessages());
   EXPECT_EQ(1167, spGroup->getType());
 
+  std::string value;
+  EXPECT_FALSE(spGroup->getField("_sel_prefix", value, "X"));
+  // without the intro handling the leading word stays part of the first key
+  EXPECT_TRUE(spGroup->getField("user pid", value, "X"));
+  EXPECT_EQ("1169", value);
+  EXPECT_TRUE(spGroup->getField("uid", value, "X"));
+  EXPECT_EQ("0", value);
+
+  std::map<std::string,std::string> subfields;
+  EXPECT_TRUE(spGroup->expandField("msg", 1167, subfields));
+  EXPECT_EQ("3c00001", subfields["resid"]);
+  EXPECT_EQ(0, subfields.count("_avc_status"));
+}
+
+//static ExampleRec ex_sel_user_avc2 = {1107, "audit(1267534395.930:19): user pid=1169 uid=0 auid=4294967295 ses=4294967295 subj=system_u:unconfined_r:unconfined_t msg='avc: denied { read } for request=SELinux:SELinuxGetClientContext comm=X-setest resid=3c00001 restype=<unknown> scontext=unconfined_u:unconfined_r:x_select_paste_t tcontext=unconfined_u:unconfined_r:unconfined_t tclass=x_resource : exe=\"/usr/bin/Xorg\" sauid=0 hostname=? addr=? terminal=?'"};
+
+TEST_P(AuditRecSELinuxParseTests, sel_user_avc2) {
+
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
+
+  audit_reply reply;
+  FILL_REPLY(reply, ex_sel_user_avc2);
+  
+  spCollector->onAuditRecord(reply);
+
+  spCollector->flush();
+
+  ASSERT_EQ(1, listener_->vec.size());
+
+  auto spGroup = listener_->vec[0];
+
+  ASSERT_EQ(1,spGroup->getNumMessages());
+  EXPECT_EQ(1107, spGroup->getType());
+
   std::string value;
   EXPECT_TRUE(spGroup->getField("_sel_prefix", value, "X"));
   EXPECT_EQ("user", value);
@@ -152,16 +189,21 @@ TEST_F(AuditRecSELinuxParseTests, sel_user_avc1) {
   EXPECT_EQ("1169", value);
 
   std::map<std::string,std::string> subfields;
-  EXPECT_TRUE(spGroup->expandField("msg", 1167, subfields));
+  EXPECT_TRUE(spGroup->expandField("msg", 1107, subfields));
   EXPECT_EQ("3c00001", subfields["resid"]);
   EXPECT_EQ("denied", subfields["_avc_status"]);
+
+  EXPECT_TRUE(spGroup->getField("msg__avc_status", value, "X"));
+  EXPECT_EQ("denied", value);
+  EXPECT_TRUE(spGroup->getField("msg_restype", value, "X"));
+  EXPECT_EQ("<unknown>", value);
 }
 
 // static ExampleRec ex_sel_netlabel1 = {1416,"audit(1336664587.640:413): netlabel: auid=0 ses=2 subj=unconfined_u:unconfined_r:unconfined_t:s0-s0:c0.c1023 netif=lo src=127.0.0.1 sec_obj=system_u:object_r:unconfined_t:s0-s0:c0,c100 res=1"};
 
-TEST_F(AuditRecSELinuxParseTests, sel_netlabel1) {
+TEST_P(AuditRecSELinuxParseTests, sel_netlabel1) {
 
-  auto spCollector = AuditCollectorNew(listener_);
+  auto spCollector = AuditCollectorNew(listener_, 500, parsers_);
 
   audit_reply reply;
   FILL_REPLY(reply, ex_sel_netlabel1);
@@ -183,3 +225,108 @@ TEST_F(AuditRecSELinuxParseTests, sel_netlabel1) {
   EXPECT_TRUE(spGroup->getField("auid", value, "X"));
   EXPECT_EQ("0", value);
 }
+
+TEST_P(AuditRecSELinuxParseTests, tokenizer_equivalence) {
+  SELinuxFieldsParser scalarParser(AuditRecTokenizer(false));
+  SELinuxFieldsParser vectorParser(AuditRecTokenizer(true));
+  for (auto &rec : ex_sel_records1) {
+    const char *body = rec.msg.data() + rec.msg.find("): ") + 3;
+    int bodylen = (int)(rec.msg.data() + rec.msg.size() - body);
+
+    AuditRecFieldIndex scalarFields, vectorFields;
+    bool scalarErr = scalarParser.parseFields(rec.rectype, body, bodylen, scalarFields);
+    bool vectorErr = vectorParser.parseFields(rec.rectype, body, bodylen, vectorFields);
+
+    EXPECT_EQ(scalarErr, vectorErr) << rec.msg;
+    ASSERT_EQ(scalarFields.size(), vectorFields.size()) << rec.msg;
+    for (size_t i = 0; i < scalarFields.size(); i++) {
+      auto &it = scalarFields.at(i);
+      auto fit = vectorFields.find(it.key, it.keylen, it.hash);
+      ASSERT_TRUE(fit != nullptr) << std::string(it.key, it.keylen);
+      EXPECT_EQ(it.value.start, fit->start);
+      EXPECT_EQ(it.value.len, fit->len);
+      EXPECT_EQ(it.value.isQuoted, fit->isQuoted);
+      EXPECT_EQ(it.value.encoding, fit->encoding);
+    }
+  }
+}
+
+struct CountingFieldsParser : public AuditRecFieldsParser {
+  bool handlesType(int recType) override {
+    return recType == 1234 || recType == 5000;
+  }
+  bool parseFields(int, const char *, int, AuditRecFieldIndex &dest) override {
+    calls++;
+    dest.add("_counted", string_offsets_t({0, 0, false, VALUE_PLAIN}));
+    return false;
+  }
+  int calls {0};
+};
+
+TEST_P(AuditRecSELinuxParseTests, parser_dispatch) {
+  auto spCounting = std::make_shared<CountingFieldsParser>();
+  auto spLater = std::make_shared<CountingFieldsParser>();
+  const char body[] = "a=1 b=2";
+
+  AuditRecFieldIndex index;
+  AuditRecParsers({}, tokenizer_).parseFields(1234, body, 7, index);
+  EXPECT_EQ(2, index.size());
+
+  const AuditRecParsers parsers({spCounting, spLater, spCounting}, tokenizer_);
+
+  index.clear();
+  parsers.parseFields(1234, body, 7, index);
+  EXPECT_EQ(1, spCounting->calls);
+  EXPECT_TRUE(index.find("_counted") != nullptr);
+
+  // beyond the dispatch table
+  index.clear();
+  parsers.parseFields(5000, body, 7, index);
+  EXPECT_EQ(2, spCounting->calls);
+
+  index.clear();
+  parsers.parseFields(1300, body, 7, index);
+  EXPECT_EQ(2, spCounting->calls);
+  EXPECT_EQ(2, index.size());
+
+  // earlier listed parser wins for shared types
+  EXPECT_EQ(0, spLater->calls);
+  const AuditRecParsers reversed({spLater, spCounting}, tokenizer_);
+  index.clear();
+  reversed.parseFields(1234, body, 7, index);
+  EXPECT_EQ(2, spCounting->calls);
+  EXPECT_EQ(1, spLater->calls);
+}
+
+TEST_P(AuditRecSELinuxParseTests, selinux_types) {
+  SELinuxFieldsParser parser(tokenizer_);
+  EXPECT_TRUE(parser.handlesType(1107));
+  EXPECT_TRUE(parser.handlesType(1400));
+  EXPECT_TRUE(parser.handlesType(1450));
+  EXPECT_FALSE(parser.handlesType(1300));
+  EXPECT_FALSE(parser.handlesType(1399));
+  EXPECT_FALSE(parser.handlesType(1451));
+}
+
+TEST_P(AuditRecSELinuxParseTests, parsers_per_collector) {
+  auto spSelCollector = AuditCollectorNew(listener_, 500, parsers_);
+  auto spPlainCollector = AuditCollectorNew(listener_, 500, AuditRecParsersNew({}, tokenizer_));
+
+  audit_reply reply;
+  FILL_REPLY(reply, ex_sel_policy1);
+  spSelCollector->onAuditRecord(reply);
+  spSelCollector->flush();
+  spPlainCollector->onAuditRecord(reply);
+  spPlainCollector->flush();
+
+  ASSERT_EQ(2, listener_->vec.size());
+
+  std::string value;
+  EXPECT_TRUE(listener_->vec[0]->getField("_policy_status", value, "X"));
+  EXPECT_EQ("loaded", value);
+  EXPECT_FALSE(listener_->vec[1]->getField("_policy_status", value, "X"));
+  EXPECT_TRUE(listener_->vec[1]->getField("ses", value, "X"));
+  EXPECT_EQ("2", value);
+}
+
+INSTANTIATE_TEST_SUITE_P(Tokenizers, AuditRecSELinuxParseTests, ::testing::Values(true, false));
@@ -109,7 +109,7 @@ TEST_F(AuditParseTests, v6a) {
   ASSERT_TRUE(success);
   ASSERT_EQ(10, info.family);
   ASSERT_EQ(22, info.port);
-  ASSERT_EQ("2406:da00:ff00:0000:0000:0000:34cc:ea4a", info.addr6);
+  ASSERT_EQ("2406:da00:ff00::34cc:ea4a", AuditParseUtils::ip6FromSaddr(info.addr6));
 
 }
 
@@ -121,7 +121,7 @@ TEST_F(AuditParseTests, v6a_partial) {
   ASSERT_FALSE(success);
   ASSERT_EQ(10, info.family);
   ASSERT_EQ(0, info.port);
-  ASSERT_EQ("", info.addr6);
+  ASSERT_EQ("::", AuditParseUtils::ip6FromSaddr(info.addr6));
 }
 
 
@@ -140,10 +140,34 @@ TEST_F(AuditParseTests, socket1) {
 
 
   SockAddrInfo info;
-  bool success = AuditParseUtils::parseSockAddr(saddr_socket.c_str(), saddr_socket.size(), info);
+  char path[AuditParseUtils::UNIX_PATH_MAX];
+  bool success = AuditParseUtils::parseSockAddr(saddr_socket.c_str(), saddr_socket.size(), info, path, sizeof(path));
   ASSERT_TRUE(success);
-  ASSERT_EQ("2F7661722F72756E2F6E7363642F736F636B6574", info.socketid);
+  ASSERT_EQ(1, info.family);
+  ASSERT_EQ(0, info.isAbstract);
+  ASSERT_EQ("/var/run/nscd/socket", std::string(path, info.pathlen));
 
+  // path not requested
+  success = AuditParseUtils::parseSockAddr(saddr_socket.c_str(), saddr_socket.size(), info);
+  ASSERT_TRUE(success);
+  ASSERT_EQ(0, info.pathlen);
+
+  // truncated to buffer
+  success = AuditParseUtils::parseSockAddr(saddr_socket.c_str(), saddr_socket.size(), info, path, 4);
+  ASSERT_TRUE(success);
+  ASSERT_EQ("/var", std::string(path, info.pathlen));
+}
+
+TEST_F(AuditParseTests, socket_abstract) {
+
+  // abstract name with embedded NULs, which are part of the name
+  const std::string saddr = "010000746573740000736F636B";
+  SockAddrInfo info;
+  char path[AuditParseUtils::UNIX_PATH_MAX];
+  bool success = AuditParseUtils::parseSockAddr(saddr.c_str(), saddr.size(), info, path, sizeof(path));
+  ASSERT_TRUE(success);
+  ASSERT_EQ(1, info.isAbstract);
+  ASSERT_EQ(std::string("test\0\0sock", 10), std::string(path, info.pathlen));
 }
 
 TEST_F(AuditParseTests, old_socket1) {
@@ -180,3 +204,269 @@ TEST_F(AuditParseTests, cmdline2) {
   cmdline = AuditParseUtils::extractCommandline(rec.data(), rec.size());
   EXPECT_EQ("\"\" \"\"", cmdline);
 }
+
+TEST_F(AuditParseTests, hex2ascii_impls) {
+  // mixed case, plus non-hex chars which decode to zero nibbles
+  std::string src;
+  for (int i = 0; i < 300; i++) {
+    src += "0123456789abcdefABCDEF2F746D70"[i % 30];
+    if (i % 37 == 5) { src += (char)(0x80 + i); }
+    if (i % 41 == 7) { src += 'z'; }
+  }
+  if (src.size() % 2 == 1) { src += '7'; }
+
+  for (size_t len = 2; len <= src.size(); len += 2) {
+    std::string expected(len / 2, '\0');
+    ASSERT_FALSE(Hexi::hex2ascii(Hexi::IMPL_SCALAR, (char *)expected.data(), expected.size(), src.data(), len));
+
+    for (int impl = Hexi::IMPL_SCALAR; impl < Hexi::IMPL_COUNT; impl++) {
+      if (!Hexi::isSupported((Hexi::DecodeImpl)impl)) {
+        continue;
+      }
+      std::string actual(len / 2, '\0');
+      ASSERT_FALSE(Hexi::hex2ascii((Hexi::DecodeImpl)impl, (char *)actual.data(), actual.size(), src.data(), len));
+      ASSERT_EQ(expected, actual) << Hexi::implName((Hexi::DecodeImpl)impl) << " len:" << len;
+    }
+    std::string actual(len / 2, '\0');
+    ASSERT_FALSE(Hexi::hex2ascii((char *)actual.data(), actual.size(), src.data(), len));
+    ASSERT_EQ(expected, actual) << " len:" << len;
+  }
+
+  std::string dest;
+  EXPECT_TRUE(Hexi::hex2ascii(Hexi::bestImpl(), (char *)dest.data(), 0, "2F74", 4));
+}
+
+TEST_F(AuditParseTests, checked_parse) {
+  uint8_t u8 = 0;
+  uint16_t u16 = 0;
+  uint32_t u32 = 0;
+  EXPECT_EQ(Hexi::VALID, Hexi::checkedParseU8("7f", u8));
+  EXPECT_EQ(0x7F, u8);
+  EXPECT_EQ(1, Hexi::checkedParseU8("7g", u8));
+  EXPECT_EQ(0x7F, u8);
+  EXPECT_EQ(Hexi::VALID, Hexi::checkedParseU16("0035", u16));
+  EXPECT_EQ(0x35, u16);
+  EXPECT_EQ(0, Hexi::checkedParseU16(" 035", u16));
+  EXPECT_EQ(Hexi::VALID, Hexi::checkedParseU32("7F000035", u32));
+  EXPECT_EQ(0x7F000035, u32);
+  EXPECT_EQ(7, Hexi::checkedParseU32("7F00003", u32));
+}
+
+TEST_F(AuditParseTests, checked_hex2ascii) {
+  std::string src;
+  for (int i = 0; i < 200; i++) {
+    src += "2F746D702F746865206C73"[i % 22];
+  }
+  std::string dest(src.size() / 2, '\0');
+  EXPECT_EQ(Hexi::VALID, Hexi::checkedHex2ascii((char *)dest.data(), dest.size(), src.data(), src.size()));
+  EXPECT_EQ(0, memcmp(dest.data(), "/tmp/the ls", 11));
+
+  // dangling char and short dest
+  EXPECT_EQ(4, Hexi::checkedHex2ascii((char *)dest.data(), dest.size(), src.data(), 5));
+  EXPECT_EQ(6, Hexi::checkedHex2ascii((char *)dest.data(), 3, src.data(), 8));
+
+  for (size_t bad = 0; bad < src.size(); bad += 7) {
+    std::string corrupt = src;
+    corrupt[bad] = (bad % 2) ? 'x' : '\xC3';
+    for (int impl = Hexi::IMPL_SCALAR; impl < Hexi::IMPL_COUNT; impl++) {
+      if (!Hexi::isSupported((Hexi::DecodeImpl)impl)) {
+        continue;
+      }
+      EXPECT_EQ(bad, Hexi::checkedHex2ascii((Hexi::DecodeImpl)impl, (char *)dest.data(), dest.size(), corrupt.data(), corrupt.size()))
+          << Hexi::implName((Hexi::DecodeImpl)impl);
+    }
+  }
+
+  // every tail length, the last block overlapping the one before
+
+  std::string expected(dest.size(), '\0');
+  Hexi::hex2ascii(Hexi::IMPL_SCALAR, (char *)expected.data(), expected.size(), src.data(), src.size());
+  for (int impl = Hexi::IMPL_SCALAR; impl < Hexi::IMPL_COUNT; impl++) {
+    if (!Hexi::isSupported((Hexi::DecodeImpl)impl)) {
+      continue;
+    }
+    for (size_t len = 2; len <= 80; len += 2) {
+      std::string out(len / 2, '\0');
+      EXPECT_EQ(Hexi::VALID, Hexi::checkedHex2ascii((Hexi::DecodeImpl)impl, (char *)out.data(), out.size(), src.data(), len))
+          << Hexi::implName((Hexi::DecodeImpl)impl) << " len:" << len;
+      EXPECT_EQ(expected.substr(0, len / 2), out) << Hexi::implName((Hexi::DecodeImpl)impl) << " len:" << len;
+      std::string corrupt = src.substr(0, len);
+      corrupt[len - 1] = 'g';
+      EXPECT_EQ(len - 1, Hexi::checkedHex2ascii((Hexi::DecodeImpl)impl, (char *)out.data(), out.size(), corrupt.data(), len))
+          << Hexi::implName((Hexi::DecodeImpl)impl) << " len:" << len;
+    }
+  }
+
+  // short inputs, decoded without dispatch
+
+  for (size_t len = 16; len <= 66; len += 2) {
+    EXPECT_EQ(Hexi::VALID, Hexi::checkedHex2ascii((char *)dest.data(), len / 2, src.data(), len));
+    EXPECT_EQ(0, memcmp(dest.data(), "/tmp/the ls", 11));
+    for (size_t bad = 0; bad < len; bad++) {
+      std::string corrupt = src.substr(0, len);
+      corrupt[bad] = 'g';
+      EXPECT_EQ(bad, Hexi::checkedHex2ascii((char *)dest.data(), len / 2, corrupt.data(), len)) << " len:" << len;
+    }
+  }
+}
+
+TEST_F(AuditParseTests, corrupt_saddr) {
+  SockAddrInfo info = SockAddrInfo();
+  std::string saddr = saddr2;
+  saddr[10] = 'Z';
+  ASSERT_FALSE(AuditParseUtils::parseSockAddr(saddr.c_str(), saddr.size(), info));
+
+  saddr = saddrv6a;
+  saddr[30] = '-';
+  ASSERT_FALSE(AuditParseUtils::parseSockAddr(saddr.c_str(), saddr.size(), info));
+
+  saddr = "0Z" + saddr2.substr(2);
+  ASSERT_FALSE(AuditParseUtils::parseSockAddr(saddr.c_str(), saddr.size(), info));
+}
+
+TEST_F(AuditParseTests, format_ip4) {
+  char buf[AuditParseUtils::IP4_TEXT_MAX];
+  EXPECT_EQ(7, AuditParseUtils::formatIp4(buf, 0));
+  EXPECT_STREQ("0.0.0.0", buf);
+  EXPECT_EQ(15, AuditParseUtils::formatIp4(buf, 0xFFFFFFFF));
+  EXPECT_STREQ("255.255.255.255", buf);
+  AuditParseUtils::formatIp4(buf, 0x0A00630C);
+  EXPECT_STREQ("10.0.99.12", buf);
+}
+
+static std::string fmt6(const char *hex) {
+  uint8_t addr6[16];
+  Hexi::hex2ascii((char *)addr6, sizeof(addr6), hex, 32);
+  char buf[AuditParseUtils::IP6_TEXT_MAX];
+  size_t len = AuditParseUtils::formatIp6(buf, addr6);
+  EXPECT_EQ(strlen(buf), len);
+  return buf;
+}
+
+TEST_F(AuditParseTests, format_ip6) {
+  EXPECT_EQ("::", fmt6("00000000000000000000000000000000"));
+  EXPECT_EQ("::1", fmt6("00000000000000000000000000000001"));
+  EXPECT_EQ("1::", fmt6("00010000000000000000000000000000"));
+  EXPECT_EQ("2001:db8::1", fmt6("20010DB8000000000000000000000001"));
+  // single zero group is not compressed
+  EXPECT_EQ("2001:db8:0:1:1:1:1:1", fmt6("20010DB8000000010001000100010001"));
+  // longest run wins, first on a tie
+  EXPECT_EQ("2001:0:0:1::1", fmt6("20010000000000010000000000000001"));
+  EXPECT_EQ("2001:db8::1:0:0:1", fmt6("20010DB8000000000001000000000001"));
+  EXPECT_EQ("fe80::abcd:ef01:2:300", fmt6("FE80000000000000ABCDEF0100020300"));
+  EXPECT_EQ("::ffff:192.0.2.1", fmt6("00000000000000000000FFFFC0000201"));
+  EXPECT_EQ("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", fmt6("FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF"));
+}
+
+TEST_F(AuditParseTests, format_port) {
+  char buf[AuditParseUtils::PORT_TEXT_MAX];
+  const uint32_t ports[] = { 0, 7, 10, 53, 99, 100, 443, 8080, 10000, 65535 };
+  for (auto port : ports) {
+    size_t len = AuditParseUtils::formatPort(buf, port);
+    EXPECT_EQ(std::to_string(port), std::string(buf, len));
+    EXPECT_EQ(len, strlen(buf));
+  }
+}
+
+TEST_F(AuditParseTests, batch) {
+  std::string corrupt = saddr2;
+  corrupt[9] = 'q';
+  std::vector<std::string> saddrs = { saddrv4b, saddrv6a, saddr_zero, saddr_netlink, saddr2, saddr_socket, corrupt,
+                                      saddrv4b.substr(0, 13), saddrv6a.substr(0, 22) };
+  std::vector<SockAddrSpan> spans;
+  for (auto &saddr : saddrs) {
+    spans.push_back({ saddr.data(), saddr.size() });
+  }
+  size_t n = spans.size();
+  std::vector<uint8_t> family(n);
+  std::vector<uint16_t> port(n);
+  std::vector<uint32_t> addr4(n);
+  std::vector<uint8_t> addr6(n * 16);
+  SockAddrBatch batch = { family.data(), port.data(), addr4.data(), (uint8_t (*)[16])addr6.data() };
+
+  SockAddrBatchParser parser;
+  EXPECT_EQ(4, parser.parse(spans.data(), n, batch));
+
+  for (size_t i = 0; i < n; i++) {
+    SockAddrInfo info = SockAddrInfo();
+    bool success = AuditParseUtils::parseSockAddr(spans[i].saddr, spans[i].len, info);
+    if (!success) {
+      EXPECT_EQ(0, family[i]) << i;
+      continue;
+    }
+    EXPECT_EQ(info.family, family[i]) << i;
+    EXPECT_EQ(info.family == AuditParseUtils::FAM_UNIXSOCKET ? 0 : info.port, port[i]) << i;
+    if (info.family == AuditParseUtils::FAM_IPV4) {
+      EXPECT_EQ(info.addr4, addr4[i]) << i;
+    } else if (info.family == AuditParseUtils::FAM_IPV6) {
+      EXPECT_EQ(0, memcmp(info.addr6, &addr6[i * 16], 16)) << i;
+    }
+  }
+  EXPECT_EQ("18.205.93.1", AuditParseUtils::ip4FromSaddr(addr4[0]));
+  EXPECT_EQ(53, port[4]);
+
+  // bad records among many IPv4 ones, at both ends
+
+  saddrs.clear();
+  for (int i = 0; i < 40; i++) {
+    std::string saddr = (i % 2) ? saddr2 : saddrv4b;
+    if (i == 0 || i == 17 || i == 39) {
+      saddr[4 + i % 12] = 'x';
+    }
+    saddrs.push_back(saddr);
+  }
+  spans.clear();
+  for (auto &saddr : saddrs) {
+    spans.push_back({ saddr.data(), saddr.size() });
+  }
+  n = spans.size();
+  family.resize(n);
+  port.resize(n);
+  addr4.resize(n);
+  batch = { family.data(), port.data(), addr4.data(), nullptr };
+  EXPECT_EQ(37, parser.parse(spans.data(), n, batch));
+  for (size_t i = 0; i < n; i++) {
+    SockAddrInfo info = SockAddrInfo();
+    if (!AuditParseUtils::parseSockAddr(spans[i].saddr, spans[i].len, info)) {
+      EXPECT_EQ(0, family[i]) << i;
+      continue;
+    }
+    EXPECT_EQ((int)AuditParseUtils::FAM_IPV4, family[i]) << i;
+    EXPECT_EQ(info.port, port[i]) << i;
+    EXPECT_EQ(info.addr4, addr4[i]) << i;
+  }
+}
+
+TEST_F(AuditParseTests, parse_numbers) {
+  int64_t ival = 0;
+  uint64_t uval = 0;
+  EXPECT_EQ(AuditParseUtils::NUM_OK, AuditParseUtils::parseInt64("-9223372036854775808", 20, ival));
+  EXPECT_EQ(INT64_MIN, ival);
+  EXPECT_EQ(AuditParseUtils::NUM_OK, AuditParseUtils::parseInt64("9223372036854775807", 19, ival));
+  EXPECT_EQ(INT64_MAX, ival);
+  EXPECT_EQ(AuditParseUtils::NUM_OVERFLOW, AuditParseUtils::parseInt64("9223372036854775808", 19, ival));
+  EXPECT_EQ(AuditParseUtils::NUM_MALFORMED, AuditParseUtils::parseInt64("-", 1, ival));
+  EXPECT_EQ(AuditParseUtils::NUM_MALFORMED, AuditParseUtils::parseInt64("", 0, ival));
+  EXPECT_EQ(AuditParseUtils::NUM_OK, AuditParseUtils::parseUInt64("18446744073709551615", 20, uval));
+  EXPECT_EQ(UINT64_MAX, uval);
+  EXPECT_EQ(AuditParseUtils::NUM_OVERFLOW, AuditParseUtils::parseUInt64("18446744073709551616", 20, uval));
+  EXPECT_EQ(AuditParseUtils::NUM_MALFORMED, AuditParseUtils::parseUInt64("12a", 3, uval));
+  EXPECT_EQ(AuditParseUtils::NUM_OK, AuditParseUtils::parseHex64("00fffffffffffff304", 18, uval));
+  EXPECT_EQ(0xfffffffffffff304ULL, uval);
+  EXPECT_EQ(AuditParseUtils::NUM_OVERFLOW, AuditParseUtils::parseHex64("1fffffffffffff304", 17, uval));
+  EXPECT_EQ(AuditParseUtils::NUM_MALFORMED, AuditParseUtils::parseHex64("(null)", 6, uval));
+}
+
+TEST_F(AuditParseTests, parse_fixed_digits) {
+  uint64_t val = 0;
+  EXPECT_EQ(AuditParseUtils::NUM_OK, AuditParseUtils::parseFixedDigits("1566400380", 10, val));
+  EXPECT_EQ(1566400380ULL, val);
+  EXPECT_EQ(AuditParseUtils::NUM_OK, AuditParseUtils::parseFixedDigits("0042", 4, val));
+  EXPECT_EQ(42, val);
+  EXPECT_EQ(AuditParseUtils::NUM_OK, AuditParseUtils::parseFixedDigits("9999999999999999999", 19, val));
+  EXPECT_EQ(9999999999999999999ULL, val);
+  const char *bad[] = { "15664003/0", "1566400:80", "156640038 " };
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(AuditParseUtils::NUM_MALFORMED, AuditParseUtils::parseFixedDigits(bad[i], 10, val)) << bad[i];
+  }
+}